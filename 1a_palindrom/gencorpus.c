@@ -0,0 +1,311 @@
+/**
+ * @file gencorpus.c
+ * @date 16.10.2026
+ *
+ * @brief Synthetic corpus generator for the ispalindrom benchmark.
+ * Writes LINES lines to stdout. Line lengths follow the given distribution,
+ * a share of the lines are palindroms (after removing spaces and folding case),
+ * spaces, case flips and UTF-8 characters are mixed in at the given rates.
+ * The same seed always gives the same corpus.
+ * USAGE: %s [-n LINES] [-l fixed:N|uniform:MIN:MAX|geometric:MEAN] [-p RATIO] [-w RATIO] [-c RATIO] [-u RATIO] [-S SEED]
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+
+// longest line (in characters) the generator creates
+#define MAX_LINE (1 << 20)
+
+static char *pgm_name;
+
+/**
+ * Line length distribution ([-l DIST])
+ */
+enum length_dist
+{
+    DIST_FIXED,
+    DIST_UNIFORM,
+    DIST_GEOMETRIC
+};
+
+struct options
+{
+    unsigned long lines;
+    enum length_dist dist;
+    unsigned long min; // fixed length, or uniform range
+    unsigned long max;
+    double mean; // geometric mean length
+    double palindroms;
+    double spaces;
+    double case_flips;
+    double utf8;
+    unsigned long long seed;
+};
+
+static const char letters[] = "abcdefghijklmnopqrstuvwxyz";
+
+// a few two, three and four byte characters which have a simple case folding partner
+static const char *const wide[] = {"\xc3\xa9", "\xc3\xb6", "\xc3\x9f", "\xce\xa3", "\xd0\x96", "\xd0\xb6", "\xe4\xb8\xad", "\xf0\x9f\x98\x80"};
+
+static unsigned long long rng_state;
+
+static void parse_options(int argc, char **argv, struct options *opt);
+static void parse_dist(const char *arg, struct options *opt);
+static double parse_ratio(const char *arg);
+static unsigned long line_length(struct options *opt);
+static void write_line(struct options *opt, unsigned long len, const char **chars, char *line);
+static unsigned long long rng_next(void);
+static double rng_double(void);
+static void usage(void);
+
+/**
+ * Program entry point.
+ * @brief Parses the options and writes the corpus to stdout.
+ * @param argc The argument counter.
+ * @param argv The argument vector.
+ * @return Returns EXIT_SUCCESS.
+ */
+int main(int argc, char **argv)
+{
+    struct options opt = {100000, DIST_GEOMETRIC, 0, 0, 40.0, 0.5, 0.1, 0.1, 0.0, 1};
+    const char **chars;
+    char *line;
+    unsigned long i;
+
+    pgm_name = argv[0];
+    parse_options(argc, argv, &opt);
+    rng_state = opt.seed * 0x9E3779B97F4A7C15ULL + 1;
+
+    // a character is at most 4 bytes, plus one space before it and the '\n'
+    chars = malloc(MAX_LINE * sizeof(*chars));
+    line = malloc(MAX_LINE * 5 + 1);
+    if (chars == NULL || line == NULL)
+    {
+        fprintf(stderr, "malloc failed: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < opt.lines; i++)
+        write_line(&opt, line_length(&opt), chars, line);
+
+    if (fflush(stdout) == EOF)
+    {
+        fprintf(stderr, "write failed: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    free(chars);
+    free(line);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Handles the user input and sets the options n, l, p, w, c, u, S
+ * n ... number of lines
+ * l ... line length distribution (in characters)
+ * p ... share of palindrom lines
+ * w ... chance of a space in front of a character
+ * c ... chance of a case flip per ASCII letter
+ * u ... share of lines with UTF-8 characters
+ * S ... seed
+ *
+ * @param argc argument count from main
+ * @param argv argument vector from main
+ * @param opt options
+ */
+static void parse_options(int argc, char **argv, struct options *opt)
+{
+    int c;
+    char *end;
+
+    while ((c = getopt(argc, argv, "n:l:p:w:c:u:S:")) != -1)
+    {
+        switch (c)
+        {
+        case ('n'):
+            opt->lines = strtoul(optarg, &end, 10);
+            if (*end != '\0')
+                usage();
+            break;
+        case ('l'):
+            parse_dist(optarg, opt);
+            break;
+        case ('p'):
+            opt->palindroms = parse_ratio(optarg);
+            break;
+        case ('w'):
+            opt->spaces = parse_ratio(optarg);
+            break;
+        case ('c'):
+            opt->case_flips = parse_ratio(optarg);
+            break;
+        case ('u'):
+            opt->utf8 = parse_ratio(optarg);
+            break;
+        case ('S'):
+            opt->seed = strtoull(optarg, &end, 10);
+            if (*end != '\0')
+                usage();
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc)
+        usage();
+}
+
+/**
+ * @brief Parses a length distribution: fixed:N, uniform:MIN:MAX or geometric:MEAN
+ *
+ * @param arg argument of -l
+ * @param opt options
+ */
+static void parse_dist(const char *arg, struct options *opt)
+{
+    char tail;
+
+    if (sscanf(arg, "fixed:%lu%c", &opt->min, &tail) == 1)
+    {
+        opt->dist = DIST_FIXED;
+        opt->max = opt->min;
+    }
+    else if (sscanf(arg, "uniform:%lu:%lu%c", &opt->min, &opt->max, &tail) == 2 && opt->min <= opt->max)
+        opt->dist = DIST_UNIFORM;
+    else if (sscanf(arg, "geometric:%lf%c", &opt->mean, &tail) == 1 && opt->mean >= 0)
+        opt->dist = DIST_GEOMETRIC;
+    else
+        usage();
+
+    if (opt->dist != DIST_GEOMETRIC && opt->max >= MAX_LINE)
+        usage();
+}
+
+/**
+ * @brief Parses a ratio between 0 and 1
+ *
+ * @param arg the ratio as string
+ * @return the ratio
+ */
+static double parse_ratio(const char *arg)
+{
+    char *end;
+    double r = strtod(arg, &end);
+
+    if (*end != '\0' || r < 0 || r > 1)
+        usage();
+    return r;
+}
+
+/**
+ * @brief Draws the length (in characters) of the next line
+ *
+ * @param opt options
+ * @return line length, less than MAX_LINE
+ */
+static unsigned long line_length(struct options *opt)
+{
+    double len;
+
+    switch (opt->dist)
+    {
+    case DIST_FIXED:
+        return opt->min;
+    case DIST_UNIFORM:
+        return opt->min + rng_next() % (opt->max - opt->min + 1);
+    case DIST_GEOMETRIC:
+    default:
+        len = -opt->mean * log(1.0 - rng_double());
+        return len >= MAX_LINE - 1 ? MAX_LINE - 1 : (unsigned long)len;
+    }
+}
+
+/**
+ * @brief Generates one line and writes it to stdout.
+ * The line is built as characters first: one half is random, the other half
+ * mirrors it (palindrom) or is random too. Then spaces and case flips are added.
+ *
+ * @param opt options
+ * @param len number of characters
+ * @param chars room for MAX_LINE character pointers
+ * @param line room for the encoded line
+ */
+static void write_line(struct options *opt, unsigned long len, const char **chars, char *line)
+{
+    static char ascii[26][2];
+    int utf8 = rng_double() < opt->utf8;
+    int palindrom = rng_double() < opt->palindroms;
+    unsigned long i;
+    char *p = line;
+
+    if (ascii[0][0] == '\0')
+    {
+        for (i = 0; i < 26; i++)
+            ascii[i][0] = letters[i];
+    }
+
+    for (i = 0; i < len; i++)
+    {
+        if (palindrom && i >= (len + 1) / 2)
+        {
+            chars[i] = chars[len - 1 - i];
+            continue;
+        }
+        if (utf8 && rng_double() < 0.2)
+            chars[i] = wide[rng_next() % (sizeof(wide) / sizeof(wide[0]))];
+        else
+            chars[i] = ascii[rng_next() % 26];
+    }
+
+    for (i = 0; i < len; i++)
+    {
+        size_t n = strlen(chars[i]);
+
+        if (rng_double() < opt->spaces)
+            *p++ = ' ';
+        memcpy(p, chars[i], n);
+        if (n == 1 && rng_double() < opt->case_flips)
+            *p -= 'a' - 'A';
+        p += n;
+    }
+    *p++ = '\n';
+
+    fwrite(line, 1, p - line, stdout);
+}
+
+/**
+ * @brief xorshift64* pseudo random numbers
+ *
+ * @return next random number
+ */
+static unsigned long long rng_next(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * @brief uniform random number in [0, 1)
+ *
+ * @return random number
+ */
+static double rng_double(void)
+{
+    return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * @brief This function writes helpful usage information about the program to stderr.
+ * @details global variables: pgm_name
+ */
+static void usage(void)
+{
+    (void)fprintf(stderr, "USAGE: %s [-n LINES] [-l fixed:N|uniform:MIN:MAX|geometric:MEAN] [-p RATIO] [-w RATIO] [-c RATIO] [-u RATIO] [-S SEED]\n", pgm_name);
+
+    exit(EXIT_FAILURE);
+}
@@ -6,34 +6,368 @@
  * This program validates if a input is a palindrom. 
  * Inputs can be stdin or 0..* FILES. 
  * White spaces and case can be ignored. Writes output to stdout or a file ([-o FILE])   
- * USAGE: %s [-s] [-i] [-o outfile] [file...]
+ * --ignore=space,punct,digits and --fold=case ignore more character classes, all rules
+ * (with -i and -s) are then compiled into one table and applied in a single pass per line.
+ * With -u lines are compared by UTF-8 code point, -i then uses simple Unicode case folding.
+ * With -l the longest palindromic substring of every line is reported instead (bytes, linear time).
+ * With -k N lines with up to N mismatched character pairs count as (near) palindroms,
+ * the output reports the number of mismatches of every line.
+ * With -d lines are DNA sequences, palindroms equal their reverse complement (GAATTC). Lines with
+ * other bases than A, C, G and T (like N) are reported separately.
+ * With -w every file as a whole is checked instead of line by line, reading it from both ends.
+ * With -c N verdicts of up to N distinct lines are cached, for inputs that repeat lines a lot.
+ * With -q DEPTH file arguments are opened, read and closed through io_uring, DEPTH files at a time
+ * (serial runs only, the normal path is taken where io_uring is not available).
+ * With -v counters, the time spent reading, normalizing, comparing and writing and the throughput
+ * are printed to stderr at exit. To time the phases, lines are then checked in batches.
+ * The output can be reduced to matching/non matching lines, a count or one verdict byte per line ([-m MODE]).
+ * Several files can be checked by parallel worker threads ([-j N]), the output keeps the argument order.
+ * Large regular files (and stdin redirected from one) are split at line boundaries between the workers,
+ * other stdin is read in batches by a reader thread and checked by the workers.
+ * USAGE: %s [-s] [-i] [-u] [-l] [-w] [-v] [-z] [-k N] [-d] [-j N] [-c N] [-q DEPTH] [-m MODE] [--ignore=CLASSES] [--fold=case] [-o outfile] [file...]
  **/
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <time.h>
 #include <getopt.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <pthread.h>
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define HAVE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+#include "palindrome.h"
+
+// size of the output buffer, it is written with one writev() when full
+#define OUTBUF_SIZE (1 << 20)
+
+// upper bound for -j
+#define MAX_WORKERS (256)
+
+// jobs a worker may run ahead of the writer, per worker
+#define JOBS_PER_WORKER (4)
+
+// regular files larger than this are split into jobs of about this size for -j
+#define SPLIT_SIZE (4 << 20)
+
+// minimum size of a batch the reader thread cuts from a stream for -j
+#define BATCH_SIZE (1 << 20)
+
+// most lines checked per batch
+#define BATCH_LINES (256)
+
+// a batch of lines ends after this many bytes, so that it is still cached when it is compared
+#define BATCH_BYTES (64 << 10)
+
+// size of each of the two read windows for -w
+#define WINDOW_SIZE (64 << 10)
+
+// upper bound for -c
+#define MAX_CACHE (1 << 26)
+
+// bytes of a line kept in a cache entry to tell lines with the same hash apart
+#define CACHE_PREFIX (16)
+
+// upper bound for -q
+#define MAX_QUEUE_DEPTH (4096)
+
+// first read size per file of the io_uring path, doubled while a file doesn't fit
+#define URING_READ_SIZE (64 << 10)
+
+// getopt_long() values of the options without a short form
+#define OPT_IGNORE (256)
+#define OPT_FOLD (257)
 
 static char *pgm_name;
 
+/**
+ * What is written for every checked line ([-m MODE])
+ * MODE_FULL    ... the line and "is (not) a palindrom" (default)
+ * MODE_MATCH   ... only lines which are palindroms
+ * MODE_NOMATCH ... only lines which are not palindroms
+ * MODE_COUNT   ... nothing, a summary is written at the end
+ * MODE_BITS    ... one '1' or '0' byte per line, no delimiter
+ * With -d, lines with unknown bases are neither matching nor non matching,
+ * full reports them as such and bits writes 'N' for them.
+ * With -l, full writes the longest palindromic substring of each line and every mode
+ * but count writes "OFFSET LENGTH" of it per line.
+ * With -w, the modes work on file names instead of lines.
+ */
+enum output_mode
+{
+    MODE_FULL,
+    MODE_MATCH,
+    MODE_NOMATCH,
+    MODE_COUNT,
+    MODE_BITS
+};
+
 struct options
 {
-    int opt_i;
-    int opt_s;
-    FILE *output;
+    struct pal_options pal; // -i, -s, -u
+    int opt_l;
+    int opt_w;
+    int opt_v;
+    long max_mismatches; // -k, -1 for exact palindroms
+    int opt_d;
+    enum output_mode mode;
+    char delim; // terminates every written line, '\0' with -z
+    int workers;
+    size_t cache_size; // entries of the verdict cache per worker, 0 disables it
+    int queue_depth;   // files in flight on the io_uring path, 0 disables it
+    int output;
+    unsigned int rules;     // --ignore and --fold (PAL_IGNORE_*, PAL_FOLD_CASE)
+    struct pal_table table; // rules with -i and -s, used by the checks if rules are given and always by -w
+};
+
+/**
+ * Read window for -w: holds bytes [base, base + len) of the file.
+ */
+struct window
+{
+    off_t base;
+    size_t len;
+    unsigned char buf[WINDOW_SIZE];
+};
+
+/**
+ * Output buffer. Buffers with a file descriptor are written out when full,
+ * buffers with fd -1 grow and keep everything in memory.
+ */
+struct outbuf
+{
+    int fd;
+    char *data;
+    size_t len;
+    size_t cap;
+    int tty; // fd is a terminal: flushed after every chunk of input, not only when full
+};
+
+/**
+ * Verdict cache for -c. A cached line is identified by its hash, its length
+ * and its first CACHE_PREFIX bytes. Entries are replaced with the CLOCK algorithm,
+ * index is an open addressing table (linear probing) from hash to entry number + 1.
+ */
+struct cache_entry
+{
+    uint64_t hash;
+    size_t len;
+    unsigned char prefix[CACHE_PREFIX];
+    unsigned char verdict;
+    unsigned char ref; // set on a hit, cleared when the clock hand passes
+};
+
+struct cache
+{
+    struct cache_entry *entries;
+    size_t size;
+    size_t used;
+    size_t hand;
+    uint32_t *index;
+    size_t mask;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+};
+
+/**
+ * Counters for -v. The counters are always kept, phase times only with -v
+ * (once per batch of lines, not per line). With -j the phase times of all threads add up.
+ */
+struct stats
+{
+    unsigned long long bytes;
+    size_t longest;   // longest line (-w: file) in bytes
+    double read;      // seconds spent reading input and splitting it into lines
+    double normalize; // removing spaces (-s)
+    double compare;   // comparing and cache lookups (-w: reading the file as well)
+    double write;     // formatting and writing output
+};
+
+/**
+ * Everything that changes while lines are checked.
+ */
+struct context
+{
+    struct pal_scratch scratch;
+    struct outbuf *out;
+    unsigned long lines;
+    unsigned long palindroms;
+    unsigned long unknown; // -d: lines with other bases than A, C, G and T
+    struct cache cache;
+    struct stats stats;
+};
+
+/**
+ * Result of checking one line. With -l offset and length locate the
+ * longest palindromic substring, with -k mismatches counts the differing pairs.
+ */
+struct verdict
+{
+    int ret;
+    size_t offset;
+    size_t length;
+    size_t mismatches; // at most max_mismatches + 1
+};
+
+/**
+ * One piece of work for the pool: a whole file, a byte range of a large one
+ * or a batch of lines read from a stream.
+ * Its output is kept in memory until all jobs before it are written.
+ */
+struct job
+{
+    char *file_name; // NULL for stdin
+    off_t origin;    // offset the input starts at (stdin may be positioned)
+    off_t start;     // byte range, start and end are moved to the next line boundary
+    off_t end;       // by the worker, -1 checks the whole file
+    struct outbuf in; // complete lines read by the reader thread (stream mode)
+    struct outbuf out;
+    unsigned long lines;
+    unsigned long palindroms;
+    unsigned long unknown;
+    int err;  // errno if the file could not be opened, 0 otherwise
+    int done; // set by the worker, cleared by the writer
+};
+
+/**
+ * Worker pool for -j. Jobs live in a ring of window slots, job i uses slot i % window.
+ * Workers create jobs in argument order when they claim them, a large file yields
+ * one job per SPLIT_SIZE bytes. In stream mode a reader thread creates the jobs instead.
+ * Neither workers nor the reader run more than window jobs ahead of the writer.
+ */
+struct pool
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond; // signalled when a job is done or a slot is free again
+    struct job *jobs;
+    size_t window;
+    size_t next;    // next job to be claimed by a worker
+    size_t written; // jobs written by the writer
+    char **files;
+    size_t nfiles;
+    size_t file;   // file the next job is taken from
+    off_t origin;  // where the current file starts (if it is split)
+    off_t offset;  // start of the next job in the current file, -1 if not split (yet)
+    off_t size;    // size of the current file (if it is split)
+    int stream;    // fd read by the reader thread, -1 if jobs are files
+    size_t filled; // jobs created by the reader thread
+    double read;   // seconds the reader thread spent in read()
+    struct options *opt;
+};
+
+#ifdef HAVE_IO_URING
+/**
+ * Submission and completion ring of an io_uring instance, mapped from the kernel
+ */
+struct uring
+{
+    int fd;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned queued; // sqes not yet passed to io_uring_enter()
+};
+#endif
+
+/**
+ * A file on the io_uring path. It has at most one request in flight,
+ * the user data of the request is the slot number.
+ */
+enum uring_state
+{
+    URING_OPEN,
+    URING_READ,
+    URING_CLOSE,
+    URING_DONE
+};
+
+struct uring_file
+{
+    enum uring_state state;
+    int fd;
+    int err; // errno of a failed open
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+struct worker
+{
+    pthread_t thread;
+    struct pool *pool;
+    struct context ctx;
 };
 
 //Prototypes
-static int is_palindrom(char *str, struct options *opt);
 static void usage(void);
-static char *str_toupper(char *str);
+static void open_failed(struct outbuf *out, int err);
 static void hande_input_options(int argc, char **argv, struct options *opt);
-static void write_input(char *input_line, struct options *opt);
-static void handle_file(char *file_name, struct options *opt);
-static void handle_file_v(FILE *file, struct options *opt);
-static void remove_space(char *str);
+static void write_input(const char *input_line, size_t len, const struct verdict *v, struct options *opt, struct context *ctx);
+static int handle_file(char *file_name, struct options *opt, struct context *ctx);
+static void handle_files_parallel(char **files, int nfiles, struct options *opt, struct context *ctx);
+static void handle_stream_parallel(int fd, struct options *opt, struct context *ctx);
+static void run_pool(struct pool *pool, struct context *ctx);
+static int pool_claim(struct pool *pool, struct job **job);
+static void *pool_worker(void *arg);
+static void *pool_reader(void *arg);
+static int handle_file_range(struct job *job, struct options *opt, struct context *ctx);
+static int handle_file_mmap(int fd, size_t size, struct options *opt, struct context *ctx);
+static void handle_buffer(const char *data, size_t size, struct options *opt, struct context *ctx);
+static void handle_buffer_timed(const char *data, size_t size, struct options *opt, struct context *ctx);
+static void handle_file_v(FILE *file, struct options *opt, struct context *ctx);
+static void write_longest(const char *input_line, size_t len, const struct verdict *v, struct options *opt, struct context *ctx);
+static void check_line(const char *str, size_t len, struct verdict *v, struct options *opt, struct context *ctx);
+static void set_mismatches(struct verdict *v, size_t mismatches, struct options *opt);
+static void check_batch(const struct pal_view *lines, size_t n, struct verdict *v, struct options *opt, struct context *ctx);
+static uint64_t cache_seed(struct options *opt);
+static uint64_t hash64(const void *data, size_t len, uint64_t seed);
+static void cache_init(struct cache *cache, size_t size);
+static int cache_lookup(struct cache *cache, uint64_t hash, const char *str, size_t len);
+static void cache_insert(struct cache *cache, uint64_t hash, const char *str, size_t len, int verdict);
+static void cache_unlink(struct cache *cache, size_t e);
+static void cache_free(struct cache *cache);
+static int handle_files_uring(char **files, int nfiles, struct options *opt, struct context *ctx);
+#ifdef HAVE_IO_URING
+static int uring_init(struct uring *ring, unsigned entries);
+static void uring_free(struct uring *ring);
+static void uring_queue(struct uring *ring, int op, int fd, void *addr, unsigned len, unsigned long long data);
+static void uring_complete(struct uring *ring, struct uring_file *files);
+#endif
+static int handle_whole_file(char *file_name, struct options *opt, struct context *ctx);
+static int is_palindrom_file(int fd, off_t size, struct options *opt);
+static void window_read(int fd, struct window *w, off_t base, size_t len);
+static void outbuf_init(struct outbuf *ob, int fd);
+static void outbuf_write(struct outbuf *ob, const char *data, size_t len);
+static void outbuf_reserve(struct outbuf *ob, size_t len);
+static void outbuf_putc(struct outbuf *ob, char c);
+static void outbuf_putnum(struct outbuf *ob, unsigned long n);
+static void outbuf_flush(struct outbuf *ob);
+static void write_all(int fd, struct iovec *iov, int iovcnt);
+static double now(void);
+static void scratch_failed(void);
 
 /**
  * Program entry point.
@@ -46,36 +380,118 @@ static void remove_space(char *str);
  */
 int main(int argc, char **argv)
 {
+    double start = now(), t;
     pgm_name = argv[0];
 
-    struct options opt = {0, 0, stdout};
+    struct options opt = {{0, 0, 0, NULL}, 0, 0, 0, -1, 0, MODE_FULL, '\n', 1, 0, 0, STDOUT_FILENO, 0};
     hande_input_options(argc, argv, &opt);
 
+    struct outbuf out;
+    struct context ctx = {{NULL, 0, NULL, 0, 0}, &out, 0, 0, 0};
+    outbuf_init(&out, opt.output);
+
     // input
-    if (argc - optind > 0)
+    struct stat st;
+    if (opt.opt_w != 0)
     {
         int i;
+        if (argc - optind == 0 && handle_whole_file(NULL, &opt, &ctx) == -1)
+            open_failed(&out, errno);
         for (i = optind; i < argc; i++)
         {
-            handle_file(argv[i], &opt);
+            if (handle_whole_file(argv[i], &opt, &ctx) == -1)
+                open_failed(&out, errno);
+        }
+    }
+    else if (argc - optind > 0 && opt.workers > 1)
+    {
+        handle_files_parallel(argv + optind, argc - optind, &opt, &ctx);
+    }
+    else if (opt.workers > 1 && fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        char *stdin_only[] = {NULL};
+        handle_files_parallel(stdin_only, 1, &opt, &ctx);
+    }
+    else if (opt.workers > 1 && argc - optind == 0)
+    {
+        handle_stream_parallel(STDIN_FILENO, &opt, &ctx);
+    }
+    else if (argc - optind > 0)
+    {
+        int i;
+        if (opt.queue_depth == 0 || handle_files_uring(argv + optind, argc - optind, &opt, &ctx) == -1)
+        {
+            for (i = optind; i < argc; i++)
+            {
+                if (handle_file(argv[i], &opt, &ctx) == -1)
+                    open_failed(&out, errno);
+            }
         }
     }
     else
     {
-        handle_file_v(stdin, &opt);
+        handle_file_v(stdin, &opt, &ctx);
+    }
+
+    if (opt.mode == MODE_COUNT)
+    {
+        char summary[128];
+        int n = snprintf(summary, sizeof(summary), "%lu of %lu %s are palindroms", ctx.palindroms, ctx.lines, opt.opt_w != 0 ? "files" : "lines");
+        if (opt.opt_d != 0)
+            n += snprintf(summary + n, sizeof(summary) - n, ", %lu contain unknown bases", ctx.unknown);
+        summary[n++] = '\n';
+        outbuf_write(&out, summary, n);
     }
+    t = now();
+    outbuf_flush(&out);
+    ctx.stats.write += now() - t;
 
-    fclose(opt.output);
+    if (opt.opt_v != 0)
+    {
+        const char *unit = opt.opt_w != 0 ? "file" : "line";
+        double wall = now() - start;
+
+        fprintf(stderr, "%s: %lu %ss, %llu bytes, %lu palindroms, longest %s %lu bytes\n", pgm_name,
+                ctx.lines, unit, ctx.stats.bytes, ctx.palindroms, unit, (unsigned long)ctx.stats.longest);
+        fprintf(stderr, "%s: %.3f s wall time, read %.3f s, normalize %.3f s, compare %.3f s, write %.3f s\n", pgm_name,
+                wall, ctx.stats.read, ctx.stats.normalize, ctx.stats.compare, ctx.stats.write);
+        fprintf(stderr, "%s: %.0f %ss/s, %.1f MB/s\n", pgm_name, ctx.lines / wall, unit, ctx.stats.bytes / wall / 1e6);
+        fprintf(stderr, "%s: %lu bytes allocated for scratch buffers\n", pgm_name, (unsigned long)ctx.scratch.allocated);
+    }
+    if (opt.cache_size != 0)
+    {
+        unsigned long lookups = ctx.cache.hits + ctx.cache.misses;
+        fprintf(stderr, "%s: cache: %lu hits, %lu misses, %.1f%% hit rate, %lu evictions\n", pgm_name,
+                ctx.cache.hits, ctx.cache.misses, lookups == 0 ? 0.0 : 100.0 * ctx.cache.hits / lookups, ctx.cache.evictions);
+    }
+
+    pal_scratch_free(&ctx.scratch);
+    cache_free(&ctx.cache);
+    free(out.data);
+    close(opt.output);
     exit(EXIT_SUCCESS);
     return 0;
 }
 
 /**
  * Hanles user input and sets options 
- * @brief This function handles the user input and checks the options s, i ,o
+ * @brief This function handles the user input and checks the options s, i, u, l, w, v, z, k, d, j, c, q, m, o
  * i ... ignore case 
  * s ... ignore whitespaces
+ * u ... compare UTF-8 code points instead of bytes
+ * l ... report the longest palindromic substring
+ * w ... check whole files instead of lines
  * o ... outputfile
+ * v ... print counters, phase times and throughput to stderr
+ * z ... terminate written lines with '\0' instead of '\n'
+ * k ... number of mismatched character pairs a palindrom may have
+ * d ... DNA sequences, compared with their reverse complement
+ * j ... number of worker threads for file arguments
+ * c ... number of cached verdicts (per worker thread)
+ * q ... io_uring queue depth (files in flight)
+ * m ... output mode: full, match, nomatch, count or bits
+ * --ignore ... comma separated character classes to ignore: space (all white space), punct, digits
+ * --fold ... case: fold case like -i
  * 
  * @param argc argument count from main
  * @param argv argument vector from main 
@@ -83,24 +499,122 @@ int main(int argc, char **argv)
  */
 static void hande_input_options(int argc, char **argv, struct options *opt)
 {
+    static const struct option long_options[] = {
+        {"ignore", required_argument, NULL, OPT_IGNORE},
+        {"fold", required_argument, NULL, OPT_FOLD},
+        {NULL, 0, NULL, 0}};
     int c;
 
-    while ((c = getopt(argc, argv, "sio:")) != -1)
+    while ((c = getopt_long(argc, argv, "siulwvzk:dj:c:q:m:o:", long_options, NULL)) != -1)
     {
         switch (c)
         {
+        case (OPT_IGNORE):
+        {
+            const char *p = optarg;
+            for (;;)
+            {
+                size_t n = strcspn(p, ",");
+                if (n == 5 && strncmp(p, "space", n) == 0)
+                    opt->rules |= PAL_IGNORE_SPACE;
+                else if (n == 5 && strncmp(p, "punct", n) == 0)
+                    opt->rules |= PAL_IGNORE_PUNCT;
+                else if (n == 6 && strncmp(p, "digits", n) == 0)
+                    opt->rules |= PAL_IGNORE_DIGITS;
+                else
+                    usage();
+                if (p[n] == '\0')
+                    break;
+                p += n + 1;
+            }
+            break;
+        }
+        case (OPT_FOLD):
+            if (strcmp(optarg, "case") != 0)
+                usage();
+            opt->rules |= PAL_FOLD_CASE;
+            opt->pal.ignore_case = 1; // folds non ASCII code points with -u
+            break;
         case ('s'):
-            opt->opt_s = 1;
+            opt->pal.ignore_space = 1;
             break;
         case ('i'):
-            opt->opt_i = 1;
+            opt->pal.ignore_case = 1;
+            break;
+        case ('u'):
+            opt->pal.utf8 = 1;
+            break;
+        case ('l'):
+            opt->opt_l = 1;
+            break;
+        case ('w'):
+            opt->opt_w = 1;
+            break;
+        case ('v'):
+            opt->opt_v = 1;
+            break;
+        case ('d'):
+            opt->opt_d = 1;
+            break;
+        case ('z'):
+            opt->delim = '\0';
+            break;
+        case ('k'):
+        {
+            char *end;
+            long n = strtol(optarg, &end, 10);
+            if (*end != '\0' || n < 0 || optarg[0] == '\0')
+                usage();
+            opt->max_mismatches = n;
+            break;
+        }
+        case ('j'):
+        {
+            char *end;
+            long n = strtol(optarg, &end, 10);
+            if (*end != '\0' || n < 1 || n > MAX_WORKERS)
+                usage();
+            opt->workers = n;
+            break;
+        }
+        case ('c'):
+        {
+            char *end;
+            long n = strtol(optarg, &end, 10);
+            if (*end != '\0' || n < 1 || n > MAX_CACHE)
+                usage();
+            opt->cache_size = n;
+            break;
+        }
+        case ('q'):
+        {
+            char *end;
+            long n = strtol(optarg, &end, 10);
+            if (*end != '\0' || n < 1 || n > MAX_QUEUE_DEPTH)
+                usage();
+            opt->queue_depth = n;
+            break;
+        }
+        case ('m'):
+            if (strcmp(optarg, "full") == 0)
+                opt->mode = MODE_FULL;
+            else if (strcmp(optarg, "match") == 0)
+                opt->mode = MODE_MATCH;
+            else if (strcmp(optarg, "nomatch") == 0)
+                opt->mode = MODE_NOMATCH;
+            else if (strcmp(optarg, "count") == 0)
+                opt->mode = MODE_COUNT;
+            else if (strcmp(optarg, "bits") == 0)
+                opt->mode = MODE_BITS;
+            else
+                usage();
             break;
         case ('o'):
             if (optarg == NULL)
                 usage();
-            if ((opt->output = fopen(optarg, "w")) == NULL)
+            if ((opt->output = open(optarg, O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1)
             {
-                fprintf(stderr, "fopen failed: %s\n", strerror(errno));
+                fprintf(stderr, "open failed: %s\n", strerror(errno));
                 exit(EXIT_FAILURE);
             }
             break;
@@ -108,134 +622,1757 @@ static void hande_input_options(int argc, char **argv, struct options *opt)
             usage();
         }
     }
+
+    if (opt->opt_w != 0 && opt->opt_l != 0)
+        usage();
+    if ((opt->opt_l != 0 || opt->opt_w != 0) && opt->pal.utf8 != 0)
+        usage(); // the longest palindrom and whole files are compared byte by byte
+    if (opt->max_mismatches != -1 && (opt->opt_w != 0 || opt->opt_l != 0))
+        usage();
+    if (opt->opt_d != 0 && (opt->opt_w != 0 || opt->opt_l != 0 || opt->max_mismatches != -1 || opt->pal.ignore_case != 0 ||
+                            opt->pal.ignore_space != 0 || opt->pal.utf8 != 0 || opt->rules != 0))
+        usage(); // case is always ignored, nothing else applies to sequences
+
+    // -i and -s alone keep their SIMD paths, the table is only used with more rules
+    // -w -s skips line breaks as well
+    pal_table_init(&opt->table, opt->rules | (opt->pal.ignore_case != 0 ? PAL_FOLD_CASE : 0) |
+                                    (opt->pal.ignore_space != 0 ? PAL_IGNORE_BLANK : 0) |
+                                    (opt->pal.ignore_space != 0 && opt->opt_w != 0 ? PAL_IGNORE_NEWLINE : 0));
+    if (opt->rules != 0)
+        opt->pal.table = &opt->table;
 }
 
 /**
  * 
  * @brief Reads a file line by line and and validates every line if it's a palindrom. 
+ * Regular files are memory mapped and checked in place, everything else
+ * (pipes, character devices, empty files) falls back to handle_file_v().
  * Writes validated string to output opion
  * 
  * @param file_name file name of file to read
  * @param opt options
+ * @param ctx context
+ * @return returns 0 on success, -1 (and errno) if the file could not be opened
  */
-static void handle_file(char *file_name, struct options *opt)
+static int handle_file(char *file_name, struct options *opt, struct context *ctx)
 {
     FILE *file;
+    struct stat st;
+    int fd;
+
+    if ((fd = open(file_name, O_RDONLY)) == -1)
+        return -1;
 
-    if ((file = fopen(file_name, "r")) == NULL)
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
     {
-        fprintf(stderr, "fopen failed: %s\n", strerror(errno));
-        exit(EXIT_FAILURE);
+        if (handle_file_mmap(fd, st.st_size, opt, ctx) == 0)
+        {
+            close(fd);
+            return 0;
+        }
     }
 
-    handle_file_v(file, opt);
+    if ((file = fdopen(fd, "r")) == NULL)
+    {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+
+    handle_file_v(file, opt, ctx);
 
     fclose(file);
+    return 0;
 }
 
 /**
+ * @brief Checks files opened, read and closed through io_uring.
+ * Up to opt->queue_depth files are in flight, file i uses slot i % depth.
+ * Every file is read completely into the buffer of its slot, the buffers
+ * are checked in argument order as soon as the next file is done.
  * 
- * @brief Reads a file line by line and and validates every line if it's a palindrom. 
- * Writes validated string to output opion
- * 
- * @param file_name file name of file to read
+ * @param files file names
+ * @param nfiles number of files
  * @param opt options
+ * @param ctx context
+ * @return returns 0 on success, -1 (and nothing is read) if io_uring is not available
+ */
+static int handle_files_uring(char **files, int nfiles, struct options *opt, struct context *ctx)
+{
+#ifdef HAVE_IO_URING
+    struct uring ring;
+    struct uring_file *slots;
+    int depth = opt->queue_depth, next = 0, head = 0, i;
+    double t;
+
+    if (nfiles < depth)
+        depth = nfiles;
+    if (uring_init(&ring, depth) == -1)
+        return -1;
+
+    if ((slots = calloc(depth, sizeof(*slots))) == NULL)
+    {
+        fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    while (head < nfiles)
+    {
+        for (; next < nfiles && next - head < depth; next++)
+        {
+            struct uring_file *f = &slots[next % depth];
+            f->state = URING_OPEN;
+            f->err = 0;
+            f->len = 0;
+            uring_queue(&ring, IORING_OP_OPENAT, AT_FDCWD, files[next], 0, next % depth);
+        }
+
+        t = now();
+        uring_complete(&ring, slots);
+        ctx->stats.read += now() - t;
+
+        for (; head < next && slots[head % depth].state == URING_DONE; head++)
+        {
+            struct uring_file *f = &slots[head % depth];
+            if (f->err != 0)
+                open_failed(ctx->out, f->err);
+            handle_buffer(f->data, f->len, opt, ctx);
+        }
+    }
+
+    for (i = 0; i < depth; i++)
+        free(slots[i].data);
+    free(slots);
+    uring_free(&ring);
+    return 0;
+#else
+    (void)files;
+    (void)nfiles;
+    (void)opt;
+    (void)ctx;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+#ifdef HAVE_IO_URING
+/**
+ * @brief Sets up an io_uring instance and maps its rings
+ * 
+ * @param ring ring to set up
+ * @param entries submission queue size
+ * @return returns 0 on success, -1 (and errno) if io_uring is missing, forbidden or too old
  */
-static void handle_file_v(FILE *file, struct options *opt)
+static int uring_init(struct uring *ring, unsigned entries)
 {
-    size_t size = 0;
-    char *line = NULL;
+    struct io_uring_params p;
+    char *sq;
+    char *cq;
+
+    memset(&p, 0, sizeof(p));
+    if ((ring->fd = syscall(__NR_io_uring_setup, entries, &p)) == -1)
+        return -1;
+
+    // IORING_OP_OPENAT and IORING_OP_CLOSE came with the same kernel (5.6)
+    if ((p.features & IORING_FEAT_RW_CUR_POS) == 0)
+    {
+        close(ring->fd);
+        errno = ENOSYS;
+        return -1;
+    }
 
-    while (getline(&line, &size, file) > 0)
+    ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED)
     {
-        if (line[strlen(line) == '\n'])
-            line[strlen(line) - 1] = '\0';
-        write_input(line, opt);
+        fprintf(stderr, "mmap failed: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
     }
+
+    sq = ring->sq_ring;
+    cq = ring->cq_ring;
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    ring->queued = 0;
+    return 0;
 }
 
 /**
- * Writes input_line to output option
- * @brief This function takes the input_line, validates if it's a palindrom and writes it to output option.
+ * @brief Unmaps the rings and closes an io_uring instance
  * 
- * @param input_line string to be validated as palindrom and to be written to output
- * @param opt options
+ * @param ring ring
  */
-static void write_input(char *input_line, struct options *opt)
+static void uring_free(struct uring *ring)
 {
-    if (is_palindrom(input_line, opt) != 0)
-        fprintf(opt->output, "%s is a palindrom\n", input_line);
-    else
-        fprintf(opt->output, "%s is not a palindrom\n", input_line);
+    munmap(ring->sqes, ring->sqes_size);
+    munmap(ring->cq_ring, ring->cq_ring_size);
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
 }
 
 /**
- * Validates if a string is a palindrom
- * @brief This function checks if the string given in the parameter is a palindrom.
- * @param str to be validated as palindrom
- * @param opt options
- * @return returns true if the string is a palindrome else returns false
+ * @brief Adds a request to the submission queue. It is passed to the kernel
+ * by the next uring_complete(). Reads use the file position (offset -1).
+ * 
+ * @param ring ring
+ * @param op IORING_OP_OPENAT, IORING_OP_READ or IORING_OP_CLOSE
+ * @param fd file descriptor (AT_FDCWD for openat)
+ * @param addr path to open or buffer to read into
+ * @param len bytes to read
+ * @param data user data, returned with the completion
  */
-static int is_palindrom(char *str, struct options *opt)
+static void uring_queue(struct uring *ring, int op, int fd, void *addr, unsigned len, unsigned long long data)
 {
-    char *d = malloc(strlen(str));
-    strcpy(d, str);
+    unsigned tail = *ring->sq_tail;
+    unsigned i = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[i];
 
-    // ignore case
-    if (opt->opt_i != 0)
-        str_toupper(d);
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)addr;
+    sqe->len = len;
+    sqe->off = op == IORING_OP_READ ? (unsigned long long)-1 : 0;
+    sqe->open_flags = op == IORING_OP_OPENAT ? O_RDONLY : 0;
+    sqe->user_data = data;
+    ring->sq_array[i] = i;
 
-    // ignore space
-    if (opt->opt_s != 0)
-        remove_space(d);
+    // the kernel must see the sqe before the new tail
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->queued++;
+}
 
-    int start = 0;
-    int end = strlen(d) - 1;
+/**
+ * @brief Submits the queued requests, waits for at least one completion and
+ * handles all completions: an opened file is read, a read file is read on
+ * (into a grown buffer if it is full) until end of file and then closed.
+ * 
+ * @param ring ring
+ * @param files slots of the files in flight
+ */
+static void uring_complete(struct uring *ring, struct uring_file *files)
+{
+    unsigned head;
 
-    while (start <= end)
+    // the kernel may take fewer sqes than queued: submit the rest before waiting again
+    for (;;)
     {
-        if (d[start] != d[end])
-            return 0;
-        start++;
-        end--;
+        long n = syscall(__NR_io_uring_enter, ring->fd, ring->queued, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EBUSY)
+            {
+                fprintf(stderr, "io_uring_enter failed: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            // out of resources: handle the completions first, the rest is submitted next time
+            if (*ring->cq_head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+                break;
+            continue;
+        }
+        ring->queued -= n;
+        if (ring->queued == 0)
+            break;
+    }
+
+    for (head = *ring->cq_head; head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE); head++)
+    {
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        struct uring_file *f = &files[cqe->user_data];
+        int res = cqe->res;
+
+        switch (f->state)
+        {
+        case URING_OPEN:
+            if (res < 0)
+            {
+                f->err = -res;
+                f->state = URING_DONE;
+                break;
+            }
+            f->fd = res;
+            f->state = URING_READ;
+            break;
+        case URING_READ:
+            if (res > 0)
+            {
+                f->len += res;
+                break;
+            }
+            // end of file, a read error ends the file like in handle_file_v()
+            f->state = URING_CLOSE;
+            uring_queue(ring, IORING_OP_CLOSE, f->fd, NULL, 0, cqe->user_data);
+            break;
+        case URING_CLOSE:
+        case URING_DONE:
+            f->state = URING_DONE;
+            break;
+        }
+
+        if (f->state == URING_READ)
+        {
+            if (f->len == f->cap)
+            {
+                size_t cap = f->cap == 0 ? URING_READ_SIZE : f->cap * 2;
+                char *data = realloc(f->data, cap);
+                if (data == NULL)
+                {
+                    fprintf(stderr, "realloc failed: %s\n", strerror(errno));
+                    exit(EXIT_FAILURE);
+                }
+                f->data = data;
+                f->cap = cap;
+            }
+            uring_queue(ring, IORING_OP_READ, f->fd, f->data + f->len, f->cap - f->len > (1U << 30) ? (1U << 30) : f->cap - f->len, cqe->user_data);
+        }
     }
 
-    free(d);
+    // the slots of the seen cqes can be reused
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+#endif
+
+/**
+ * @brief Checks files with opt->workers threads.
+ * Every file, or every SPLIT_SIZE range of a large regular file, is a job whose
+ * output is buffered in memory. The calling thread writes the jobs in order,
+ * so the output is the same as in a serial run.
+ * 
+ * @param files file names, NULL stands for stdin
+ * @param nfiles number of files
+ * @param opt options
+ * @param ctx context of the calling thread, receives the output and the counters
+ */
+static void handle_files_parallel(char **files, int nfiles, struct options *opt, struct context *ctx)
+{
+    struct pool pool;
+
+    pool.files = files;
+    pool.nfiles = nfiles;
+    pool.stream = -1;
+    pool.opt = opt;
+    run_pool(&pool, ctx);
+}
+
+/**
+ * @brief Checks a stream that can't be split up front (pipe, terminal) with opt->workers threads.
+ * A reader thread cuts the stream into batches of complete lines, the workers check
+ * the batches and the calling thread writes them in order.
+ * 
+ * @param fd stream to read
+ * @param opt options
+ * @param ctx context of the calling thread, receives the output and the counters
+ */
+static void handle_stream_parallel(int fd, struct options *opt, struct context *ctx)
+{
+    struct pool pool;
 
-    return 1;
+    pool.files = NULL;
+    pool.nfiles = 1; // done when the reader hits end of file
+    pool.stream = fd;
+    pool.opt = opt;
+    run_pool(&pool, ctx);
 }
 
 /**
- * @brief removes all space from input string
+ * @brief Starts the workers (and the reader thread in stream mode) of a pool,
+ * writes the jobs in order as they are done and tears the pool down again.
  * 
- * @param str input string
+ * @param pool pool with files, nfiles, stream and opt set
+ * @param ctx context of the calling thread, receives the output and the counters
  */
-static void remove_space(char *str)
+static void run_pool(struct pool *pool, struct context *ctx)
 {
-    for (char *reader = str; *reader != '\0'; ++reader)
+    struct worker workers[MAX_WORKERS];
+    pthread_t reader;
+    int i, nworkers = pool->opt->workers;
+    size_t n;
+    double t;
+
+    pool->window = nworkers * JOBS_PER_WORKER;
+    pool->next = 0;
+    pool->written = 0;
+    pool->filled = 0;
+    pool->read = 0;
+    pool->file = 0;
+    pool->offset = -1;
+    if ((pool->jobs = calloc(pool->window, sizeof(*pool->jobs))) == NULL)
+    {
+        fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    for (n = 0; n < pool->window; n++)
+    {
+        outbuf_init(&pool->jobs[n].out, -1);
+        if (pool->stream != -1)
+            outbuf_init(&pool->jobs[n].in, -1);
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    for (i = 0; i < nworkers; i++)
     {
-        if (*reader != ' ')
+        memset(&workers[i].ctx, 0, sizeof(workers[i].ctx));
+        workers[i].pool = pool;
+        if ((errno = pthread_create(&workers[i].thread, NULL, pool_worker, &workers[i])) != 0)
         {
-            *str = *reader;
-            ++str;
+            fprintf(stderr, "pthread_create failed: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
         }
     }
-    *str = '\0';
+    if (pool->stream != -1 && (errno = pthread_create(&reader, NULL, pool_reader, pool)) != 0)
+    {
+        fprintf(stderr, "pthread_create failed: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    // writer: wait for the jobs in order and append their output
+    for (;;)
+    {
+        struct job *job = &pool->jobs[pool->written % pool->window];
+
+        // in stream mode jobs exist once the reader filled them, claimed or not
+        pthread_mutex_lock(&pool->lock);
+        while (job->done == 0 && (pool->file < pool->nfiles || pool->written < (pool->stream != -1 ? pool->filled : pool->next)))
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        pthread_mutex_unlock(&pool->lock);
+        if (job->done == 0)
+            break; // all jobs written
+
+        t = now();
+        outbuf_write(ctx->out, job->out.data, job->out.len);
+        ctx->stats.write += now() - t;
+        if (job->err != 0)
+            open_failed(ctx->out, job->err);
+        ctx->lines += job->lines;
+        ctx->palindroms += job->palindroms;
+        ctx->unknown += job->unknown;
+
+        pthread_mutex_lock(&pool->lock);
+        job->out.len = 0;
+        job->done = 0;
+        pool->written++;
+        pthread_cond_broadcast(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    if (pool->stream != -1)
+        pthread_join(reader, NULL);
+    ctx->stats.read += pool->read;
+    for (i = 0; i < nworkers; i++)
+    {
+        struct stats *st = &workers[i].ctx.stats;
+
+        pthread_join(workers[i].thread, NULL);
+        ctx->stats.bytes += st->bytes;
+        if (st->longest > ctx->stats.longest)
+            ctx->stats.longest = st->longest;
+        ctx->stats.read += st->read;
+        ctx->stats.normalize += st->normalize;
+        ctx->stats.compare += st->compare;
+        ctx->stats.write += st->write;
+        ctx->scratch.allocated += workers[i].ctx.scratch.allocated;
+        ctx->cache.hits += workers[i].ctx.cache.hits;
+        ctx->cache.misses += workers[i].ctx.cache.misses;
+        ctx->cache.evictions += workers[i].ctx.cache.evictions;
+        pal_scratch_free(&workers[i].ctx.scratch);
+        cache_free(&workers[i].ctx.cache);
+    }
+    for (n = 0; n < pool->window; n++)
+    {
+        free(pool->jobs[n].out.data);
+        free(pool->jobs[n].in.data);
+    }
+    free(pool->jobs);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->cond);
 }
 
 /**
-* transforms all chars in string to uppercase
-* @brief Takes a string and returns the same string transfomed in uppercase
-* @param *str: input string to be transformed to uppercase
-* @return param: *str in uppercase
-*/
-static char *str_toupper(char *str)
+ * @brief Creates the next job and hands it to the calling worker.
+ * Waits while the window is full. A file is stat'ed when its first job is
+ * created, large regular files are cut into SPLIT_SIZE ranges.
+ * In stream mode it waits for the next job filled by the reader thread instead.
+ * Must be called with pool->lock held.
+ * 
+ * @param pool pool
+ * @param job receives the claimed job
+ * @return 0 if a job was claimed, -1 if there is no work left
+ */
+static int pool_claim(struct pool *pool, struct job **job)
 {
-    for (; *str != '\0'; str++)
+    struct job *j;
+    struct stat st;
+
+    if (pool->stream != -1)
     {
-        *str = toupper(*str);
+        while (pool->next == pool->filled && pool->file < pool->nfiles)
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        if (pool->next == pool->filled)
+            return -1;
+        *job = &pool->jobs[pool->next++ % pool->window];
+        return 0;
     }
-    return "d";
+
+    while (pool->file < pool->nfiles && pool->next - pool->written >= pool->window)
+        pthread_cond_wait(&pool->cond, &pool->lock);
+    if (pool->file >= pool->nfiles)
+        return -1;
+
+    j = &pool->jobs[pool->next++ % pool->window];
+    j->file_name = pool->files[pool->file];
+
+    if (pool->offset == -1)
+    {
+        char *name = j->file_name;
+        int ret = name == NULL ? fstat(STDIN_FILENO, &st) : stat(name, &st);
+        off_t origin = name == NULL ? lseek(STDIN_FILENO, 0, SEEK_CUR) : 0;
+
+        if (ret == 0 && S_ISREG(st.st_mode) && origin != -1 && st.st_size - origin > SPLIT_SIZE)
+        {
+            pool->origin = origin;
+            pool->offset = origin;
+            pool->size = st.st_size;
+        }
+    }
+
+    if (pool->offset == -1)
+    {
+        j->origin = 0;
+        j->start = 0;
+        j->end = -1;
+        pool->file++;
+    }
+    else
+    {
+        j->origin = pool->origin;
+        j->start = pool->offset;
+        j->end = pool->size - pool->offset > SPLIT_SIZE ? pool->offset + SPLIT_SIZE : pool->size;
+        pool->offset = j->end;
+        if (pool->offset == pool->size)
+        {
+            pool->offset = -1;
+            pool->file++;
+        }
+    }
+
+    *job = j;
+    return 0;
+}
+
+/**
+ * @brief Thread function of a pool worker: claims the next job, checks it
+ * into the job's output buffer and marks it done, until all jobs are claimed.
+ * 
+ * @param arg struct worker of this thread
+ * @return NULL
+ */
+static void *pool_worker(void *arg)
+{
+    struct worker *w = arg;
+    struct pool *pool = w->pool;
+    struct job *job;
+
+    for (;;)
+    {
+        int ret;
+
+        pthread_mutex_lock(&pool->lock);
+        ret = pool_claim(pool, &job);
+        pthread_cond_broadcast(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+        if (ret == -1)
+            return NULL;
+
+        w->ctx.out = &job->out;
+        w->ctx.lines = 0;
+        w->ctx.palindroms = 0;
+        w->ctx.unknown = 0;
+        if (pool->stream != -1)
+            handle_buffer(job->in.data, job->in.len, pool->opt, &w->ctx);
+        else if (job->end == -1 && job->file_name == NULL)
+            handle_file_v(stdin, pool->opt, &w->ctx); // stdin too small to split
+        else if (job->end == -1)
+            ret = handle_file(job->file_name, pool->opt, &w->ctx);
+        else
+            ret = handle_file_range(job, pool->opt, &w->ctx);
+        job->err = ret == -1 ? errno : 0;
+        job->lines = w->ctx.lines;
+        job->palindroms = w->ctx.palindroms;
+        job->unknown = w->ctx.unknown;
+
+        pthread_mutex_lock(&pool->lock);
+        job->done = 1;
+        pthread_cond_broadcast(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/**
+ * @brief Thread function of the reader in stream mode: reads the stream into the
+ * input buffers of consecutive jobs. Every batch ends at the last '\n' read,
+ * the rest of a line is carried over to the next batch. A read error ends the
+ * stream like end of file (as getline() does in handle_file_v()).
+ * 
+ * @param arg struct pool
+ * @return NULL
+ */
+static void *pool_reader(void *arg)
+{
+    struct pool *pool = arg;
+    struct outbuf carry;
+    double t;
+    int eof = 0;
+
+    outbuf_init(&carry, -1);
+
+    while (eof == 0)
+    {
+        struct job *job;
+        size_t cut;
+
+        pthread_mutex_lock(&pool->lock);
+        while (pool->filled - pool->written >= pool->window)
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        pthread_mutex_unlock(&pool->lock);
+
+        job = &pool->jobs[pool->filled % pool->window];
+        job->in.len = 0;
+        outbuf_write(&job->in, carry.data, carry.len);
+        carry.len = 0;
+
+        // read until the batch is big enough and holds at least one complete line
+        for (cut = 0; eof == 0 && (job->in.len < BATCH_SIZE || cut == 0);)
+        {
+            ssize_t n;
+            size_t i;
+
+            outbuf_reserve(&job->in, BATCH_SIZE / 2);
+            t = now();
+            n = read(pool->stream, job->in.data + job->in.len, job->in.cap - job->in.len);
+            pool->read += now() - t;
+            if (n == -1 && errno == EINTR)
+                continue;
+            if (n <= 0)
+            {
+                eof = 1;
+                break;
+            }
+            for (i = job->in.len + n; i > job->in.len; i--)
+            {
+                if (job->in.data[i - 1] == '\n')
+                {
+                    cut = i;
+                    break;
+                }
+            }
+            job->in.len += n;
+        }
+
+        if (eof == 0)
+        {
+            outbuf_write(&carry, job->in.data + cut, job->in.len - cut);
+            job->in.len = cut;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        if (job->in.len > 0)
+            pool->filled++;
+        if (eof != 0)
+            pool->file = pool->nfiles;
+        pthread_cond_broadcast(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    free(carry.data);
+    return NULL;
+}
+
+/**
+ * @brief Checks the lines of a byte range of a regular file.
+ * The range start and end are moved forward to the next line start, so every line
+ * is checked by exactly the job its first byte falls into.
+ * 
+ * @param job job with file name and range
+ * @param opt options
+ * @param ctx context
+ * @return returns 0 on success, -1 (and errno) if the file could not be opened or mapped
+ */
+static int handle_file_range(struct job *job, struct options *opt, struct context *ctx)
+{
+    int fd = job->file_name == NULL ? STDIN_FILENO : open(job->file_name, O_RDONLY);
+    struct stat st;
+    char *data;
+    off_t start = job->start, end = job->end;
+
+    if (fd == -1)
+        return -1;
+    if (fstat(fd, &st) == -1 || (data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+    {
+        int err = errno;
+        if (fd != STDIN_FILENO)
+            close(fd);
+        errno = err;
+        return -1;
+    }
+
+    // the file may have shrunk since the job was created
+    if (end > st.st_size)
+        end = st.st_size;
+    if (start > job->origin && start < end)
+    {
+        char *nl = memchr(data + start - 1, '\n', st.st_size - start + 1);
+        start = nl == NULL ? st.st_size : nl - data + 1;
+    }
+    if (end < st.st_size && end > job->origin)
+    {
+        char *nl = memchr(data + end - 1, '\n', st.st_size - end + 1);
+        end = nl == NULL ? st.st_size : nl - data + 1;
+    }
+
+    if (start < end)
+    {
+        off_t page = start & ~(off_t)(sysconf(_SC_PAGESIZE) - 1);
+        (void)madvise(data + page, end - page, MADV_SEQUENTIAL);
+        handle_buffer(data + start, end - start, opt, ctx);
+    }
+
+    munmap(data, st.st_size);
+    if (fd != STDIN_FILENO)
+        close(fd);
+    return 0;
+}
+
+/**
+ * @brief Checks if a whole file is a palindrom and writes the result like write_input()
+ * does for a line, with the file name in place of the line.
+ * 
+ * @param file_name file to check, NULL for stdin (which has to be seekable)
+ * @param opt options
+ * @param ctx context
+ * @return returns 0 on success, -1 (and errno) if the file could not be opened
+ */
+static int handle_whole_file(char *file_name, struct options *opt, struct context *ctx)
+{
+    int fd = file_name == NULL ? STDIN_FILENO : open(file_name, O_RDONLY);
+    char *name = file_name == NULL ? "-" : file_name;
+    struct stat st;
+    double t;
+    int ret;
+
+    if (fd == -1)
+        return -1;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+    {
+        if (fd != STDIN_FILENO)
+            close(fd);
+        errno = ESPIPE; // only regular files can be read from the end
+        return -1;
+    }
+
+    t = now();
+    ret = is_palindrom_file(fd, st.st_size, opt);
+    if (fd != STDIN_FILENO)
+        close(fd);
+    ctx->stats.compare += now() - t;
+    ctx->stats.bytes += st.st_size;
+    if ((size_t)st.st_size > ctx->stats.longest)
+        ctx->stats.longest = st.st_size;
+
+    ctx->lines++;
+    ctx->palindroms += ret;
+
+    switch (opt->mode)
+    {
+    case MODE_FULL:
+        outbuf_write(ctx->out, name, strlen(name));
+        if (ret != 0)
+            outbuf_write(ctx->out, " is a palindrom", 15);
+        else
+            outbuf_write(ctx->out, " is not a palindrom", 19);
+        outbuf_putc(ctx->out, opt->delim);
+        break;
+    case MODE_MATCH:
+    case MODE_NOMATCH:
+        if ((ret != 0) == (opt->mode == MODE_MATCH))
+        {
+            outbuf_write(ctx->out, name, strlen(name));
+            outbuf_putc(ctx->out, opt->delim);
+        }
+        break;
+    case MODE_BITS:
+        outbuf_putc(ctx->out, ret != 0 ? '1' : '0');
+        break;
+    case MODE_COUNT:
+        break;
+    }
+    return 0;
+}
+
+/**
+ * Validates if a file is a palindrom
+ * @brief Reads the file with pread() through two windows, one moving forward from
+ * the start and one moving backward from the end, until they meet or a byte differs.
+ * Normalization happens on the fly: -i folds case, -s skips ' ' and '\n'.
+ * A single '\n' at the end of the file is not part of the content.
+ * Memory use is two windows, independent of the file size.
+ * 
+ * @param fd regular file
+ * @param size size of the file
+ * @param opt options
+ * @return 1 if the file is a palindrom, else 0
+ */
+static int is_palindrom_file(int fd, off_t size, struct options *opt)
+{
+    struct window front, back;
+    off_t start = 0, end = size;
+    int c, d;
+
+    front.base = 0;
+    front.len = 0;
+    back.base = end;
+    back.len = 0;
+
+    if (end > 0)
+    {
+        window_read(fd, &back, end - 1, 1);
+        if (back.buf[0] == '\n')
+            end--;
+        back.base = end;
+        back.len = 0;
+    }
+
+    for (;;)
+    {
+        // next byte from the front
+        do
+        {
+            if (start >= end)
+                return 1;
+            if (start >= front.base + (off_t)front.len)
+                window_read(fd, &front, start, end - start < WINDOW_SIZE ? end - start : WINDOW_SIZE);
+            c = front.buf[start++ - front.base];
+        } while (opt->table.keep[c] == 0);
+
+        // next byte from the back
+        do
+        {
+            if (end <= start)
+                return 1; // c was the middle byte
+            if (end <= back.base)
+            {
+                off_t base = end - start < WINDOW_SIZE ? start : end - WINDOW_SIZE;
+                window_read(fd, &back, base, end - base);
+            }
+            d = back.buf[--end - back.base];
+        } while (opt->table.keep[d] == 0);
+
+        if (opt->table.map[c] != opt->table.map[d])
+            return 0;
+    }
+}
+
+/**
+ * @brief Fills a window with len bytes of the file starting at base.
+ * Exits the program on a read error or if the file shrank.
+ * 
+ * @param fd file
+ * @param w window
+ * @param base file offset
+ * @param len number of bytes, at most WINDOW_SIZE
+ */
+static void window_read(int fd, struct window *w, off_t base, size_t len)
+{
+    size_t got = 0;
+
+    while (got < len)
+    {
+        ssize_t n = pread(fd, w->buf + got, len - got, base + got);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            fprintf(stderr, "pread failed: %s\n", n == 0 ? "unexpected end of file" : strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        got += n;
+    }
+    w->base = base;
+    w->len = len;
+}
+
+/**
+ * @brief Maps a regular file into memory and validates every line in place.
+ * 
+ * @param fd open file descriptor of a regular file
+ * @param size size of the file in bytes
+ * @param opt options
+ * @param ctx context
+ * @return returns 0 on success, -1 if the file could not be mapped
+ */
+static int handle_file_mmap(int fd, size_t size, struct options *opt, struct context *ctx)
+{
+    char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+        return -1;
+
+    // lines are consumed front to back exactly once
+    (void)madvise(data, size, MADV_SEQUENTIAL);
+
+    handle_buffer(data, size, opt, ctx);
+
+    munmap(data, size);
+    return 0;
+}
+
+/**
+ * @brief Splits a buffer at '\n' and validates every line without copying it.
+ * A trailing line without '\n' is validated as well.
+ * 
+ * @param data start of the buffer
+ * @param size size of the buffer in bytes
+ * @param opt options
+ * @param ctx context
+ */
+static void handle_buffer(const char *data, size_t size, struct options *opt, struct context *ctx)
+{
+    const char *end = data + size;
+    struct verdict v;
+
+    ctx->stats.bytes += size;
+    if (opt->opt_v != 0)
+    {
+        handle_buffer_timed(data, size, opt, ctx);
+        return;
+    }
+
+    while (data < end)
+    {
+        const char *nl = memchr(data, '\n', end - data);
+        size_t len = (nl == NULL ? end : nl) - data;
+
+        if (len > ctx->stats.longest)
+            ctx->stats.longest = len;
+        check_line(data, len, &v, opt, ctx);
+        write_input(data, len, &v, opt, ctx);
+        data = nl == NULL ? end : nl + 1;
+    }
+}
+
+/**
+ * @brief handle_buffer() for -v: the lines are cut, checked and written in batches
+ * of up to BATCH_LINES lines, each of these phases is timed once per batch.
+ * 
+ * @param data start of the buffer
+ * @param size size of the buffer in bytes
+ * @param opt options
+ * @param ctx context
+ */
+static void handle_buffer_timed(const char *data, size_t size, struct options *opt, struct context *ctx)
+{
+    struct pal_view lines[BATCH_LINES];
+    struct verdict v[BATCH_LINES];
+    const char *end = data + size;
+    double t = now(), t1;
+    size_t i, n;
+
+    while (data < end)
+    {
+        // cut the next lines, the first touch of mapped pages counts as reading
+        size_t bytes = 0;
+        for (n = 0; n < BATCH_LINES && bytes < BATCH_BYTES && data < end; n++)
+        {
+            const char *nl = memchr(data, '\n', end - data);
+            lines[n].data = data;
+            lines[n].len = (nl == NULL ? end : nl) - data;
+            if (lines[n].len > ctx->stats.longest)
+                ctx->stats.longest = lines[n].len;
+            bytes += lines[n].len;
+            data = nl == NULL ? end : nl + 1;
+        }
+        t1 = now();
+        ctx->stats.read += t1 - t;
+
+        check_batch(lines, n, v, opt, ctx);
+
+        t = now();
+        for (i = 0; i < n; i++)
+            write_input(lines[i].data, lines[i].len, &v[i], opt, ctx);
+        t1 = now();
+        ctx->stats.write += t1 - t;
+        t = t1;
+    }
+}
+
+/**
+ * 
+ * @brief Reads a stream in chunks and validates every line if it's a palindrom. 
+ * Used for stdin and for files that can't be memory mapped.
+ * The complete lines of every chunk are checked by handle_buffer(),
+ * the rest of a line is moved to the front and completed by the next chunk.
+ * A terminal is read with read(), which returns after every line, and the
+ * verdicts go out right away if the output is a terminal too.
+ * Writes validated string to output opion
+ * 
+ * @param file stream to read
+ * @param opt options
+ * @param ctx context
+ */
+static void handle_file_v(FILE *file, struct options *opt, struct context *ctx)
+{
+    struct outbuf in;
+    size_t n;
+    int tty = isatty(fileno(file));
+
+    outbuf_init(&in, -1);
+    for (;;)
+    {
+        const char *nl;
+        double t = now();
+
+        outbuf_reserve(&in, BATCH_BYTES);
+        if (tty)
+        {
+            ssize_t r;
+            while ((r = read(fileno(file), in.data + in.len, in.cap - in.len)) == -1 && errno == EINTR)
+                ;
+            n = r > 0 ? r : 0;
+        }
+        else
+            n = fread(in.data + in.len, 1, in.cap - in.len, file);
+        ctx->stats.read += now() - t;
+        if (n == 0)
+            break; // end of file, a read error ends the stream like end of file
+
+        // only the new bytes can hold the last '\n'
+        nl = in.data + in.len + n;
+        while (nl > in.data + in.len && nl[-1] != '\n')
+            nl--;
+        in.len += n;
+        if (nl > in.data + in.len - n)
+        {
+            size_t cut = nl - in.data;
+            handle_buffer(in.data, cut, opt, ctx);
+            memmove(in.data, in.data + cut, in.len - cut);
+            in.len -= cut;
+            if (ctx->out->tty)
+                outbuf_flush(ctx->out);
+        }
+    }
+    handle_buffer(in.data, in.len, opt, ctx);
+
+    free(in.data);
+}
+
+/**
+ * Writes input_line to output option
+ * @brief This function takes the input_line and its verdict and writes
+ * the result in the selected output mode to the output buffer of the context.
+ * 
+ * @param input_line the validated string to be written to output (not '\0' terminated)
+ * @param len length of input_line
+ * @param v verdict of check_batch()
+ * @param opt options
+ * @param ctx context
+ */
+static void write_input(const char *input_line, size_t len, const struct verdict *v, struct options *opt, struct context *ctx)
+{
+    static const char yes[] = " is a palindrom";
+    static const char no[] = " is not a palindrom";
+    static const char unknown[] = " contains unknown bases";
+    int ret = v->ret;
+
+    if (opt->opt_l != 0)
+    {
+        write_longest(input_line, len, v, opt, ctx);
+        return;
+    }
+
+    ctx->lines++;
+    if (ret == PAL_DNA_UNKNOWN && opt->opt_d != 0)
+    {
+        ctx->unknown++;
+        if (opt->mode == MODE_FULL)
+        {
+            outbuf_write(ctx->out, input_line, len);
+            outbuf_write(ctx->out, unknown, sizeof(unknown) - 1);
+            outbuf_putc(ctx->out, opt->delim);
+        }
+        else if (opt->mode == MODE_BITS)
+            outbuf_putc(ctx->out, 'N');
+        return;
+    }
+    ctx->palindroms += ret;
+
+    switch (opt->mode)
+    {
+    case MODE_FULL:
+        outbuf_write(ctx->out, input_line, len);
+        if (ret != 0)
+            outbuf_write(ctx->out, yes, sizeof(yes) - 1);
+        else
+            outbuf_write(ctx->out, no, sizeof(no) - 1);
+        if (opt->max_mismatches != -1)
+        {
+            if (ret != 0)
+            {
+                outbuf_write(ctx->out, " (", 2);
+                outbuf_putnum(ctx->out, v->mismatches);
+            }
+            else
+            {
+                outbuf_write(ctx->out, " (more than ", 12);
+                outbuf_putnum(ctx->out, opt->max_mismatches);
+            }
+            outbuf_write(ctx->out, " mismatches)", 12);
+        }
+        outbuf_putc(ctx->out, opt->delim);
+        break;
+    case MODE_MATCH:
+    case MODE_NOMATCH:
+        if ((ret != 0) == (opt->mode == MODE_MATCH))
+        {
+            outbuf_write(ctx->out, input_line, len);
+            outbuf_putc(ctx->out, opt->delim);
+        }
+        break;
+    case MODE_BITS:
+        outbuf_putc(ctx->out, ret != 0 ? '1' : '0');
+        break;
+    case MODE_COUNT:
+        break;
+    }
+}
+
+/**
+ * @brief Checks a line through the verdict cache of the context (if -c is given).
+ * With -l the longest palindromic substring is searched instead.
+ * With -k the mismatches are counted, the cache then holds the count (if it fits).
+ * With -d the line is checked as DNA sequence.
+ * 
+ * @param str line to check
+ * @param len length of str
+ * @param v receives the verdict
+ * @param opt options
+ * @param ctx context
+ */
+static void check_line(const char *str, size_t len, struct verdict *v, struct options *opt, struct context *ctx)
+{
+    uint64_t hash = 0;
+
+    if (opt->opt_l != 0)
+    {
+        if ((v->ret = pal_longest(str, len, &opt->pal, &ctx->scratch, &v->offset, &v->length)) == -1)
+            scratch_failed();
+        return;
+    }
+
+    if (opt->cache_size != 0)
+    {
+        if (ctx->cache.entries == NULL)
+            cache_init(&ctx->cache, opt->cache_size);
+        hash = hash64(str, len, cache_seed(opt));
+        if ((v->ret = cache_lookup(&ctx->cache, hash, str, len)) != -1)
+        {
+            if (opt->max_mismatches != -1)
+                set_mismatches(v, v->ret, opt);
+            return;
+        }
+    }
+
+    if (opt->max_mismatches != -1)
+    {
+        long n = pal_mismatches(str, len, &opt->pal, &ctx->scratch, opt->max_mismatches);
+        if (n == -1)
+            scratch_failed();
+        set_mismatches(v, n, opt);
+    }
+    else if (opt->opt_d != 0)
+    {
+        if ((v->ret = pal_check_dna(str, len, &ctx->scratch)) == -1)
+            scratch_failed();
+    }
+    else if ((v->ret = pal_check(str, len, &opt->pal, &ctx->scratch)) == -1)
+        scratch_failed();
+    if (opt->cache_size != 0)
+        cache_insert(&ctx->cache, hash, str, len, opt->max_mismatches != -1 ? (int)v->mismatches : v->ret);
+}
+
+/**
+ * @brief Sets the verdict of a line from its mismatch count (-k)
+ * 
+ * @param v verdict
+ * @param mismatches mismatch count of the line, at most max_mismatches + 1
+ * @param opt options
+ */
+static void set_mismatches(struct verdict *v, size_t mismatches, struct options *opt)
+{
+    v->mismatches = mismatches;
+    v->ret = mismatches <= (size_t)opt->max_mismatches;
+}
+
+/**
+ * @brief check_line() for a batch of lines (-v). Verdicts are taken from the cache (if -c is given)
+ * where possible, the other lines are normalized (-s) into the scratch buffer in one
+ * pass and compared in a second one, so that each phase can be timed once per batch.
+ * 
+ * @param lines lines to check
+ * @param n number of lines, at most BATCH_LINES
+ * @param v receives the verdict of every line
+ * @param opt options
+ * @param ctx context
+ */
+static void check_batch(const struct pal_view *lines, size_t n, struct verdict *v, struct options *opt, struct context *ctx)
+{
+    struct pal_view norm[BATCH_LINES];
+    const struct pal_view *cmp = lines;
+    uint64_t hash[BATCH_LINES];
+    double t0 = now(), t1, t2;
+    size_t i, total = 0;
+
+    if (opt->opt_l != 0 || opt->opt_d != 0)
+    {
+        for (i = 0; i < n; i++)
+            check_line(lines[i].data, lines[i].len, &v[i], opt, ctx);
+        ctx->stats.compare += now() - t0;
+        return;
+    }
+
+    if (opt->cache_size != 0 && ctx->cache.entries == NULL)
+        cache_init(&ctx->cache, opt->cache_size);
+
+    for (i = 0; i < n; i++)
+    {
+        v[i].ret = -1;
+        if (opt->cache_size != 0)
+        {
+            hash[i] = hash64(lines[i].data, lines[i].len, cache_seed(opt));
+            v[i].ret = cache_lookup(&ctx->cache, hash[i], lines[i].data, lines[i].len);
+            if (v[i].ret != -1 && opt->max_mismatches != -1)
+                set_mismatches(&v[i], v[i].ret, opt);
+        }
+        total += lines[i].len;
+    }
+    t1 = now();
+
+    // ignore space
+    if (opt->pal.ignore_space != 0 || opt->pal.table != NULL)
+    {
+        char *d;
+
+        if (pal_scratch_reserve(&ctx->scratch, total) == -1)
+            scratch_failed();
+        d = ctx->scratch.buf;
+        for (i = 0; i < n; i++)
+        {
+            if (v[i].ret != -1)
+                continue;
+            norm[i].data = d;
+            norm[i].len = pal_normalize(d, lines[i].data, lines[i].len, &opt->pal);
+            d += norm[i].len;
+        }
+        cmp = norm;
+    }
+    t2 = now();
+
+    for (i = 0; i < n; i++)
+    {
+        if (v[i].ret != -1)
+            continue;
+        if (opt->max_mismatches != -1)
+            set_mismatches(&v[i], pal_count_mismatches(cmp[i].data, cmp[i].len, &opt->pal, opt->max_mismatches), opt);
+        else
+            v[i].ret = pal_compare(cmp[i].data, cmp[i].len, &opt->pal);
+        if (opt->cache_size != 0)
+            cache_insert(&ctx->cache, hash[i], lines[i].data, lines[i].len, opt->max_mismatches != -1 ? (int)v[i].mismatches : v[i].ret);
+    }
+
+    ctx->stats.normalize += t2 - t1;
+    ctx->stats.compare += (t1 - t0) + (now() - t2);
+}
+
+/**
+ * @brief Seed of the cache hash: the options that change the verdict of a line
+ * 
+ * @param opt options
+ * @return seed for hash64()
+ */
+static uint64_t cache_seed(struct options *opt)
+{
+    return opt->pal.ignore_case | opt->pal.ignore_space << 1 | opt->pal.utf8 << 2 | (uint64_t)opt->rules << 3 |
+           (uint64_t)opt->opt_d << 9 | (uint64_t)(opt->max_mismatches + 1) << 10;
+}
+
+#define XXH_PRIME1 11400714785074694791ULL
+#define XXH_PRIME2 14029467366897019727ULL
+#define XXH_PRIME3 1609587929392839161ULL
+#define XXH_PRIME4 9650029242287828579ULL
+#define XXH_PRIME5 2870177450012600261ULL
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+/**
+ * @brief 64 bit hash of a byte string, the XXH64 algorithm
+ * 
+ * @param data bytes to hash
+ * @param len number of bytes
+ * @param seed seed
+ * @return hash value
+ */
+static uint64_t hash64(const void *data, size_t len, uint64_t seed)
+{
+    const unsigned char *p = data, *end = p + len;
+    uint64_t h, k;
+    uint32_t k32;
+
+    if (len >= 32)
+    {
+        uint64_t v[4] = {seed + XXH_PRIME1 + XXH_PRIME2, seed + XXH_PRIME2, seed, seed - XXH_PRIME1};
+        int i;
+
+        for (; end - p >= 32; p += 32)
+        {
+            for (i = 0; i < 4; i++)
+            {
+                memcpy(&k, p + 8 * i, 8);
+                v[i] += k * XXH_PRIME2;
+                v[i] = ROTL64(v[i], 31) * XXH_PRIME1;
+            }
+        }
+        h = ROTL64(v[0], 1) + ROTL64(v[1], 7) + ROTL64(v[2], 12) + ROTL64(v[3], 18);
+        for (i = 0; i < 4; i++)
+        {
+            v[i] *= XXH_PRIME2;
+            v[i] = ROTL64(v[i], 31) * XXH_PRIME1;
+            h = (h ^ v[i]) * XXH_PRIME1 + XXH_PRIME4;
+        }
+    }
+    else
+    {
+        h = seed + XXH_PRIME5;
+    }
+    h += len;
+
+    for (; end - p >= 8; p += 8)
+    {
+        memcpy(&k, p, 8);
+        k *= XXH_PRIME2;
+        k = ROTL64(k, 31) * XXH_PRIME1;
+        h ^= k;
+        h = ROTL64(h, 27) * XXH_PRIME1 + XXH_PRIME4;
+    }
+    if (end - p >= 4)
+    {
+        memcpy(&k32, p, 4);
+        h ^= k32 * XXH_PRIME1;
+        h = ROTL64(h, 23) * XXH_PRIME2 + XXH_PRIME3;
+        p += 4;
+    }
+    for (; p < end; p++)
+    {
+        h ^= *p * XXH_PRIME5;
+        h = ROTL64(h, 11) * XXH_PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME2;
+    h ^= h >> 29;
+    h *= XXH_PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+/**
+ * @brief Allocates a cache for size entries, the index gets at least twice as many slots
+ * 
+ * @param cache cache (zeroed)
+ * @param size number of entries
+ */
+static void cache_init(struct cache *cache, size_t size)
+{
+    size_t slots = 1;
+
+    while (slots < 2 * size)
+        slots *= 2;
+
+    cache->entries = malloc(size * sizeof(*cache->entries));
+    cache->index = calloc(slots, sizeof(*cache->index));
+    if (cache->entries == NULL || cache->index == NULL)
+    {
+        fprintf(stderr, "malloc failed: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    cache->size = size;
+    cache->used = 0;
+    cache->hand = 0;
+    cache->mask = slots - 1;
+}
+
+/**
+ * @brief Looks a line up in the cache and marks the entry as recently used
+ * 
+ * @param cache cache
+ * @param hash hash of the line
+ * @param str line
+ * @param len length of str
+ * @return the cached verdict, -1 if the line is not cached
+ */
+static int cache_lookup(struct cache *cache, uint64_t hash, const char *str, size_t len)
+{
+    size_t slot, n = len < CACHE_PREFIX ? len : CACHE_PREFIX;
+
+    for (slot = hash & cache->mask; cache->index[slot] != 0; slot = (slot + 1) & cache->mask)
+    {
+        struct cache_entry *e = &cache->entries[cache->index[slot] - 1];
+        if (e->hash == hash && e->len == len && memcmp(e->prefix, str, n) == 0)
+        {
+            e->ref = 1;
+            cache->hits++;
+            return e->verdict;
+        }
+    }
+
+    cache->misses++;
+    return -1;
+}
+
+/**
+ * @brief Adds a verdict to the cache. When the cache is full the clock hand
+ * moves on (clearing reference bits) to the first entry not used since its last pass.
+ * A line already in the cache (repeated within one batch) keeps its entry.
+ * 
+ * @param cache cache
+ * @param hash hash of the line
+ * @param str line
+ * @param len length of str
+ * @param verdict pal_check() result, or the mismatch count with -k
+ */
+static void cache_insert(struct cache *cache, uint64_t hash, const char *str, size_t len, int verdict)
+{
+    size_t e, slot, n = len < CACHE_PREFIX ? len : CACHE_PREFIX;
+
+    if (verdict > UCHAR_MAX)
+        return; // mismatch count (-k) too large for an entry
+
+    for (slot = hash & cache->mask; cache->index[slot] != 0; slot = (slot + 1) & cache->mask)
+    {
+        struct cache_entry *c = &cache->entries[cache->index[slot] - 1];
+        if (c->hash == hash && c->len == len && memcmp(c->prefix, str, n) == 0)
+            return;
+    }
+
+    if (cache->used < cache->size)
+    {
+        e = cache->used++;
+    }
+    else
+    {
+        while (cache->entries[cache->hand].ref != 0)
+        {
+            cache->entries[cache->hand].ref = 0;
+            cache->hand = (cache->hand + 1) % cache->size;
+        }
+        e = cache->hand;
+        cache->hand = (cache->hand + 1) % cache->size;
+        cache_unlink(cache, e);
+        cache->evictions++;
+    }
+
+    cache->entries[e].hash = hash;
+    cache->entries[e].len = len;
+    memcpy(cache->entries[e].prefix, str, n);
+    cache->entries[e].verdict = verdict;
+    cache->entries[e].ref = 0;
+
+    for (slot = hash & cache->mask; cache->index[slot] != 0; slot = (slot + 1) & cache->mask)
+        ;
+    cache->index[slot] = e + 1;
+}
+
+/**
+ * @brief Removes entry e from the index. The following entries of the probe
+ * sequence are shifted back, so lookups never need tombstones.
+ * 
+ * @param cache cache
+ * @param e entry number
+ */
+static void cache_unlink(struct cache *cache, size_t e)
+{
+    size_t i, j;
+
+    for (i = cache->entries[e].hash & cache->mask; cache->index[i] != e + 1; i = (i + 1) & cache->mask)
+        ;
+
+    for (j = i;;)
+    {
+        size_t home;
+
+        j = (j + 1) & cache->mask;
+        if (cache->index[j] == 0)
+            break;
+        home = cache->entries[cache->index[j] - 1].hash & cache->mask;
+        // the entry at j stays if its home slot lies cyclically in (i, j]
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+            continue;
+        cache->index[i] = cache->index[j];
+        i = j;
+    }
+    cache->index[i] = 0;
+}
+
+/**
+ * @brief Frees the memory of a cache (the statistics are kept)
+ * 
+ * @param cache cache
+ */
+static void cache_free(struct cache *cache)
+{
+    free(cache->entries);
+    free(cache->index);
+    cache->entries = NULL;
+    cache->index = NULL;
+}
+
+/**
+ * @brief Writes the longest palindromic substring of input_line
+ * (full mode) or its offset and length (other modes) to the output buffer.
+ * A line counts as palindrom if the substring covers the whole line.
+ * 
+ * @param input_line searched line (not '\0' terminated)
+ * @param len length of input_line
+ * @param v verdict of check_batch() with the substring
+ * @param opt options
+ * @param ctx context
+ */
+static void write_longest(const char *input_line, size_t len, const struct verdict *v, struct options *opt, struct context *ctx)
+{
+    char buf[96];
+    size_t offset = v->offset, length = v->length;
+    int n;
+
+    ctx->lines++;
+    ctx->palindroms += v->ret;
+
+    switch (opt->mode)
+    {
+    case MODE_FULL:
+        outbuf_write(ctx->out, input_line, len);
+        outbuf_write(ctx->out, " has the longest palindrom \"", 28);
+        outbuf_write(ctx->out, input_line + offset, length);
+        n = snprintf(buf, sizeof(buf), "\" at offset %lu, length %lu", (unsigned long)offset, (unsigned long)length);
+        outbuf_write(ctx->out, buf, n);
+        outbuf_putc(ctx->out, opt->delim);
+        break;
+    case MODE_COUNT:
+        break;
+    default:
+        n = snprintf(buf, sizeof(buf), "%lu %lu", (unsigned long)offset, (unsigned long)length);
+        outbuf_write(ctx->out, buf, n);
+        outbuf_putc(ctx->out, opt->delim);
+        break;
+    }
+}
+
+/**
+ * @brief Initializes an output buffer
+ * 
+ * @param ob output buffer
+ * @param fd file descriptor the buffer is flushed to, -1 to keep the output in memory
+ */
+static void outbuf_init(struct outbuf *ob, int fd)
+{
+    ob->fd = fd;
+    ob->len = 0;
+    ob->cap = fd == -1 ? 4096 : OUTBUF_SIZE;
+    ob->tty = fd != -1 && isatty(fd);
+    if ((ob->data = malloc(ob->cap)) == NULL)
+    {
+        fprintf(stderr, "malloc failed: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Appends data to an output buffer
+ * If it does not fit, the buffered bytes and data are written with one writev(),
+ * so long lines are never copied into the buffer.
+ * 
+ * @param ob output buffer
+ * @param data bytes to append
+ * @param len number of bytes
+ */
+static void outbuf_write(struct outbuf *ob, const char *data, size_t len)
+{
+    if (ob->cap - ob->len < len)
+    {
+        if (ob->fd != -1)
+        {
+            struct iovec iov[2] = {{ob->data, ob->len}, {(void *)data, len}};
+            write_all(ob->fd, iov, 2);
+            ob->len = 0;
+            return;
+        }
+        outbuf_reserve(ob, len);
+    }
+
+    memcpy(ob->data + ob->len, data, len);
+    ob->len += len;
+}
+
+/**
+ * @brief Grows an in memory output buffer (fd -1) until len more bytes fit
+ * 
+ * @param ob output buffer
+ * @param len number of bytes that have to fit behind ob->len
+ */
+static void outbuf_reserve(struct outbuf *ob, size_t len)
+{
+    size_t newcap = ob->cap;
+
+    if (newcap - ob->len >= len)
+        return;
+    while (newcap - ob->len < len)
+        newcap *= 2;
+
+    char *newptr = realloc(ob->data, newcap);
+    if (newptr == NULL)
+    {
+        fprintf(stderr, "realloc failed: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    ob->data = newptr;
+    ob->cap = newcap;
+}
+
+/**
+ * @brief Appends one byte to an output buffer
+ * 
+ * @param ob output buffer
+ * @param c byte to append
+ */
+static void outbuf_putc(struct outbuf *ob, char c)
+{
+    if (ob->len == ob->cap)
+        outbuf_write(ob, &c, 1);
+    else
+        ob->data[ob->len++] = c;
+}
+
+/**
+ * @brief Appends a number in decimal to an output buffer (cheaper than snprintf on every line)
+ * 
+ * @param ob output buffer
+ * @param n number to append
+ */
+static void outbuf_putnum(struct outbuf *ob, unsigned long n)
+{
+    char digits[24];
+    char *p = digits + sizeof(digits);
+
+    do
+    {
+        *--p = '0' + n % 10;
+        n /= 10;
+    } while (n != 0);
+    outbuf_write(ob, p, digits + sizeof(digits) - p);
+}
+
+/**
+ * @brief Writes all buffered bytes to the file descriptor of the buffer
+ * 
+ * @param ob output buffer
+ */
+static void outbuf_flush(struct outbuf *ob)
+{
+    struct iovec iov = {ob->data, ob->len};
+
+    if (ob->fd == -1 || ob->len == 0)
+        return;
+    write_all(ob->fd, &iov, 1);
+    ob->len = 0;
+}
+
+/**
+ * @brief writev() which retries until everything is written.
+ * Exits the program on a write error.
+ * 
+ * @param fd file descriptor
+ * @param iov buffers to write (modified)
+ * @param iovcnt number of buffers
+ */
+static void write_all(int fd, struct iovec *iov, int iovcnt)
+{
+    while (iovcnt > 0)
+    {
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "write failed: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len)
+        {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+}
+
+/**
+ * @brief Exits with an error message if the scratch buffer could not grow
+ */
+static void scratch_failed(void)
+{
+    fprintf(stderr, "realloc failed: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief monotonic clock in seconds
+ * 
+ * @return current time
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Writes everything checked so far and exits with an error message
+ * for a file that could not be opened.
+ * 
+ * @param out output buffer
+ * @param err errno of the failed open
+ */
+static void open_failed(struct outbuf *out, int err)
+{
+    outbuf_flush(out);
+    fprintf(stderr, "open failed: %s\n", strerror(err));
+    exit(EXIT_FAILURE);
 }
 
 /**
@@ -244,7 +2381,7 @@ static char *str_toupper(char *str)
  */
 static void usage(void)
 {
-    (void)fprintf(stderr, "USAGE: %s [-s] [-i] [-o outfile] [file...]\n", pgm_name);
+    (void)fprintf(stderr, "USAGE: %s [-s] [-i] [-u] [-l] [-w] [-v] [-z] [-k N] [-d] [-j N] [-c N] [-q DEPTH] [-m full|match|nomatch|count|bits] [--ignore=space,punct,digits] [--fold=case] [-o outfile] [file...]\n", pgm_name);
 
     exit(EXIT_FAILURE);
 }
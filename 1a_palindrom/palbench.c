@@ -0,0 +1,295 @@
+/**
+ * @file palbench.c
+ * @date 16.10.2026
+ *
+ * @brief Benchmark driver for ispalindrom.
+ * Runs PROGRAM on CORPUS with -i, -s, -i -s and -o, once with the corpus as
+ * file argument and once fed through a pipe on stdin, and reports lines/s,
+ * GB/s and the peak RSS of the best of RUNS runs for every combination.
+ * ARGs are passed to every run (e.g. -u or -j 4).
+ * USAGE: %s [-r RUNS] CORPUS PROGRAM [ARG...]
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+// most arguments passed through to PROGRAM
+#define MAX_ARGS (32)
+
+// file written by the -o runs, removed afterwards
+#define OUT_FILE "palbench.out"
+
+static char *pgm_name;
+
+/**
+ * One benchmarked combination of ispalindrom options
+ */
+struct config
+{
+    const char *name;
+    const char *args[3];
+};
+
+static const struct config configs[] = {
+    {"default", {NULL}},
+    {"-i", {"-i", NULL}},
+    {"-s", {"-s", NULL}},
+    {"-i -s", {"-i", "-s", NULL}},
+    {"-o", {"-o", OUT_FILE, NULL}},
+};
+
+/**
+ * Measurement of one run
+ */
+struct result
+{
+    double seconds;
+    long maxrss; // KiB
+};
+
+struct corpus
+{
+    const char *path;
+    const char *data;
+    size_t size;
+    unsigned long lines;
+};
+
+static void map_corpus(struct corpus *c);
+static void run(struct corpus *c, char **argv, int use_stdin, struct result *res);
+static void feed(int fd, struct corpus *c);
+static double now(void);
+static void error_exit(const char *msg);
+static void usage(void);
+
+/**
+ * Program entry point.
+ * @brief Runs every config on both input paths and prints one line per combination.
+ * @param argc The argument counter.
+ * @param argv The argument vector.
+ * @return Returns EXIT_SUCCESS.
+ */
+int main(int argc, char **argv)
+{
+    struct corpus corpus;
+    char *child_argv[MAX_ARGS + 8];
+    int runs = 3, c, extra, use_stdin;
+    size_t i;
+
+    pgm_name = argv[0];
+    while ((c = getopt(argc, argv, "+r:")) != -1)
+    {
+        switch (c)
+        {
+        case ('r'):
+            if ((runs = atoi(optarg)) < 1)
+                usage();
+            break;
+        default:
+            usage();
+        }
+    }
+    if (argc - optind < 2 || argc - optind - 2 > MAX_ARGS)
+        usage();
+
+    corpus.path = argv[optind];
+    map_corpus(&corpus);
+    extra = argc - optind - 2;
+
+    printf("%s: %lu lines, %lu bytes\n", corpus.path, corpus.lines, (unsigned long)corpus.size);
+    printf("%-8s %-6s %14s %10s %12s\n", "options", "input", "lines/s", "GB/s", "maxrss KiB");
+
+    for (use_stdin = 0; use_stdin <= 1; use_stdin++)
+    {
+        for (i = 0; i < sizeof(configs) / sizeof(configs[0]); i++)
+        {
+            struct result best = {0, 0};
+            int n = 0, r, a;
+
+            child_argv[n++] = argv[optind + 1];
+            for (a = 0; a < extra; a++)
+                child_argv[n++] = argv[optind + 2 + a];
+            for (a = 0; configs[i].args[a] != NULL; a++)
+                child_argv[n++] = (char *)configs[i].args[a];
+            if (use_stdin == 0)
+                child_argv[n++] = (char *)corpus.path;
+            child_argv[n] = NULL;
+
+            for (r = 0; r < runs; r++)
+            {
+                struct result res;
+                run(&corpus, child_argv, use_stdin, &res);
+                if (r == 0 || res.seconds < best.seconds)
+                    best.seconds = res.seconds;
+                if (res.maxrss > best.maxrss)
+                    best.maxrss = res.maxrss;
+            }
+
+            printf("%-8s %-6s %14.0f %10.3f %12ld\n", configs[i].name, use_stdin ? "stdin" : "file",
+                   corpus.lines / best.seconds, corpus.size / best.seconds / 1e9, best.maxrss);
+            fflush(stdout);
+        }
+    }
+
+    unlink(OUT_FILE);
+    munmap((void *)corpus.data, corpus.size);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Maps the corpus and counts its lines
+ *
+ * @param c corpus with path set
+ */
+static void map_corpus(struct corpus *c)
+{
+    struct stat st;
+    const char *p, *end;
+    int fd;
+
+    if ((fd = open(c->path, O_RDONLY)) == -1 || fstat(fd, &st) == -1)
+        error_exit("open corpus failed");
+    if (st.st_size == 0)
+        error_exit("corpus is empty");
+
+    c->size = st.st_size;
+    if ((c->data = mmap(NULL, c->size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+        error_exit("mmap failed");
+    close(fd);
+
+    c->lines = 0;
+    end = c->data + c->size;
+    for (p = c->data; (p = memchr(p, '\n', end - p)) != NULL; p++)
+        c->lines++;
+    if (c->data[c->size - 1] != '\n')
+        c->lines++;
+}
+
+/**
+ * @brief Runs the program once with stdout on /dev/null and measures it.
+ * With use_stdin the corpus is written into a pipe by a feeder process,
+ * so the program takes its stream path and not the mmap path.
+ *
+ * @param c corpus
+ * @param argv program and arguments
+ * @param use_stdin feed the corpus on stdin if not 0
+ * @param res receives wall time and peak RSS of the program
+ */
+static void run(struct corpus *c, char **argv, int use_stdin, struct result *res)
+{
+    struct rusage ru;
+    pid_t pid, feeder = -1;
+    int pipefd[2], status;
+    double start;
+
+    if (use_stdin && pipe(pipefd) == -1)
+        error_exit("pipe failed");
+
+    start = now();
+    if ((pid = fork()) == -1)
+        error_exit("fork failed");
+    if (pid == 0)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        if (null == -1 || dup2(null, STDOUT_FILENO) == -1)
+            _exit(127);
+        if (use_stdin)
+        {
+            if (dup2(pipefd[0], STDIN_FILENO) == -1)
+                _exit(127);
+            close(pipefd[0]);
+            close(pipefd[1]);
+        }
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+
+    if (use_stdin)
+    {
+        if ((feeder = fork()) == -1)
+            error_exit("fork failed");
+        if (feeder == 0)
+        {
+            close(pipefd[0]);
+            feed(pipefd[1], c);
+            _exit(0);
+        }
+        close(pipefd[0]);
+        close(pipefd[1]);
+    }
+
+    if (wait4(pid, &status, 0, &ru) == -1)
+        error_exit("wait4 failed");
+    res->seconds = now() - start;
+    res->maxrss = ru.ru_maxrss;
+
+    if (feeder != -1)
+        waitpid(feeder, NULL, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        error_exit("program failed");
+}
+
+/**
+ * @brief Writes the whole corpus to fd
+ *
+ * @param fd write end of the pipe
+ * @param c corpus
+ */
+static void feed(int fd, struct corpus *c)
+{
+    size_t off = 0;
+
+    while (off < c->size)
+    {
+        ssize_t n = write(fd, c->data + off, c->size - off);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return; // the program went away, it reports its own error
+        }
+        off += n;
+    }
+}
+
+/**
+ * @brief monotonic clock in seconds
+ *
+ * @return current time
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Prints msg and errno to stderr and exits
+ *
+ * @param msg error message
+ */
+static void error_exit(const char *msg)
+{
+    fprintf(stderr, "%s: %s: %s\n", pgm_name, msg, strerror(errno));
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief This function writes helpful usage information about the program to stderr.
+ * @details global variables: pgm_name
+ */
+static void usage(void)
+{
+    (void)fprintf(stderr, "USAGE: %s [-r RUNS] CORPUS PROGRAM [ARG...]\n", pgm_name);
+
+    exit(EXIT_FAILURE);
+}
@@ -0,0 +1,1271 @@
+/**
+ * @file palindrome.c
+ * @date 16.10.2026
+ *
+ * @brief Palindrom checking library (libpalindrome.a).
+ * The checks of ispalindrom: byte strings with optional case folding and space
+ * skipping, UTF-8 strings by code point, the number of mismatches of near palindroms,
+ * DNA sequences against their reverse complement and the longest palindromic substring.
+ * The caller owns the scratch buffers, so the library keeps no state besides
+ * the kernels chosen for the cpu at program start and can be used from any number of threads.
+ **/
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "palindrome.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/**
+ * Simple case folding for utf8 with ignore_case: code points lo..hi map to code point + delta.
+ * With stride 2 only every second code point starting at lo is mapped
+ * (upper/lower case pairs next to each other).
+ */
+struct fold_range
+{
+    unsigned int lo;
+    unsigned int hi;
+    int delta;
+    int stride;
+};
+
+static char *scratch_reserve(struct pal_scratch *scratch, size_t len);
+static const char *normalize(const char *str, size_t *len, const struct pal_options *opt, struct pal_scratch *scratch);
+static size_t *scratch_reserve_idx(struct pal_scratch *scratch, size_t n);
+#ifdef HAVE_X86_SIMD
+static void select_kernels(void) __attribute__((constructor));
+#endif
+static size_t compact_spaces_scalar(char *dst, const char *src, size_t len);
+static size_t translate_scalar(char *dst, const char *src, size_t len, const struct pal_table *table);
+static int compare_mirrored_scalar(const char *str, size_t len, int fold);
+static size_t count_mismatches_scalar(const char *str, size_t len, int fold, size_t limit);
+static int is_ascii_scalar(const char *str, size_t len);
+#ifdef HAVE_X86_SIMD
+static size_t compact_spaces_ssse3(char *dst, const char *src, size_t len);
+static size_t translate_ssse3(char *dst, const char *src, size_t len, const struct pal_table *table);
+static int compare_mirrored_sse2(const char *str, size_t len, int fold);
+static int compare_mirrored_avx2(const char *str, size_t len, int fold);
+static size_t count_mismatches_sse2(const char *str, size_t len, int fold, size_t limit);
+static size_t count_mismatches_avx2(const char *str, size_t len, int fold, size_t limit);
+static int is_ascii_sse2(const char *str, size_t len);
+static int is_ascii_avx2(const char *str, size_t len);
+#endif
+static size_t count_mismatches_utf8(const char *str, size_t len, int fold, size_t limit);
+static unsigned int utf8_next(const unsigned char *s, size_t len, size_t *n);
+static unsigned int utf8_prev(const unsigned char *s, size_t len, size_t *n);
+static unsigned int fold_code_point(unsigned int cp);
+static uint64_t reverse_complement(uint64_t x);
+static int pack_bases_scalar(uint64_t *w, const char *str, size_t len);
+#ifdef HAVE_X86_SIMD
+static int pack_bases_avx2(uint64_t *w, const char *str, size_t len);
+#endif
+static uint64_t base_window(const uint64_t *w, size_t base);
+
+/**
+ * Kernels used by pal_check(), chosen by select_kernels() before main() runs.
+ * compact_spaces copies src to dst without ' ' and returns the new length,
+ * dst needs room for len + 16 bytes. translate does the same for the bytes a table drops
+ * and maps the others.
+ * compare_mirrored returns 1 if str reads the same from both ends.
+ * count_mismatches returns the number of mirrored byte pairs that differ, it stops at limit + 1.
+ * pack_bases packs a DNA sequence into 2 bit codes, 32 per word, and returns 0 if it has unknown bases.
+ */
+static size_t (*compact_spaces)(char *dst, const char *src, size_t len) = compact_spaces_scalar;
+static size_t (*translate)(char *dst, const char *src, size_t len, const struct pal_table *table) = translate_scalar;
+static int (*compare_mirrored)(const char *str, size_t len, int fold) = compare_mirrored_scalar;
+static size_t (*count_mismatches)(const char *str, size_t len, int fold, size_t limit) = count_mismatches_scalar;
+static int (*is_ascii)(const char *str, size_t len) = is_ascii_scalar;
+static int (*pack_bases)(uint64_t *w, const char *str, size_t len) = pack_bases_scalar;
+
+/**
+ * Bases accepted by pal_check_dna(). Their 2 bit code is ((c >> 1) ^ (c >> 2)) & 3:
+ * A 0, C 1, G 2, T 3 (lower case alike), so complement = code ^ 3.
+ */
+static const unsigned char is_base[256] = {
+    ['A'] = 1, ['C'] = 1, ['G'] = 1, ['T'] = 1, ['a'] = 1, ['c'] = 1, ['g'] = 1, ['t'] = 1};
+
+#ifdef HAVE_X86_SIMD
+/**
+ * shuffle indices for the left-pack in compact_spaces_ssse3():
+ * pack_lut[m] lists the positions of the set bits in m, unused slots are 0x80 (zero)
+ */
+static unsigned char pack_lut[256][8];
+#endif
+
+/**
+ * Validates if a string is a palindrom
+ * @brief This function checks if the string given in the parameter is a palindrom.
+ * Case is folded while comparing, spaces are compacted away into the scratch buffer beforehand.
+ * Without ignore_space the string is compared in place. With a table the string is
+ * normalized into the scratch buffer in one pass and compared without folding.
+ * With utf8 strings containing non ASCII bytes are compared by code point, pure ASCII
+ * strings (the common case) take the byte path.
+ * @param str to be validated as palindrom
+ * @param len length of str
+ * @param opt options
+ * @param scratch normalization buffer
+ * @return returns 1 if the string is a palindrome, 0 if not, -1 (errno ENOMEM) if the scratch buffer could not grow
+ */
+int pal_check(const char *str, size_t len, const struct pal_options *opt, struct pal_scratch *scratch)
+{
+    if ((str = normalize(str, &len, opt, scratch)) == NULL)
+        return -1;
+
+    return pal_compare(str, len, opt);
+}
+
+/**
+ * Validates a batch of strings
+ * @brief Checks every view like pal_check() and sets bit i % 8 of verdicts[i / 8]
+ * for a palindrom. The scratch buffer is grown once up front for the longest
+ * view, so the batch itself does not allocate.
+ * @param views strings to check
+ * @param n number of views
+ * @param opt options
+ * @param scratch normalization buffer
+ * @param verdicts bitmap with room for n bits, (n + 7) / 8 bytes
+ * @return returns the number of palindroms, -1 (errno ENOMEM) if the scratch buffer could not grow
+ * or any pal_check() failed, verdicts are not valid then
+ */
+long pal_check_batch(const struct pal_view *views, size_t n, const struct pal_options *opt, struct pal_scratch *scratch, unsigned char *verdicts)
+{
+    size_t i, max = 0;
+    long count = 0;
+
+    if (opt->ignore_space != 0 || opt->table != NULL)
+    {
+        for (i = 0; i < n; i++)
+        {
+            if (views[i].len > max)
+                max = views[i].len;
+        }
+        if (pal_scratch_reserve(scratch, max) == -1)
+            return -1;
+    }
+
+    memset(verdicts, 0, (n + 7) / 8);
+    for (i = 0; i < n; i++)
+    {
+        int r = pal_check(views[i].data, views[i].len, opt, scratch);
+        if (r == -1)
+            return -1;
+        if (r == 1)
+        {
+            verdicts[i / 8] |= 1 << (i % 8);
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief First step of pal_check(): copies str to dst without spaces (ignore_space),
+ * or translated through the table.
+ * Lets a caller normalize a whole batch before comparing it with pal_compare().
+ * 
+ * @param dst destination buffer, room for len + 16 bytes
+ * @param str string to normalize
+ * @param len length of str
+ * @param opt options
+ * @return length of the normalized string in dst
+ */
+size_t pal_normalize(char *dst, const char *str, size_t len, const struct pal_options *opt)
+{
+    if (opt->table != NULL)
+        return translate(dst, str, len, opt->table);
+    if (opt->ignore_space == 0)
+    {
+        memcpy(dst, str, len);
+        return len;
+    }
+    return compact_spaces(dst, str, len);
+}
+
+/**
+ * @brief Second step of pal_check(): compares a string normalized by pal_normalize()
+ * (or any string, if ignore_space is not set)
+ * 
+ * @param str normalized string
+ * @param len length of str
+ * @param opt options
+ * @return 1 if the string is a palindrom, else 0
+ */
+int pal_compare(const char *str, size_t len, const struct pal_options *opt)
+{
+    if (opt->utf8 != 0 && is_ascii(str, len) == 0)
+        return count_mismatches_utf8(str, len, opt->ignore_case, 0) == 0;
+
+    // ignore case (a table has folded already)
+    return compare_mirrored(str, len, opt->table == NULL && opt->ignore_case != 0);
+}
+
+/**
+ * Counts the mismatches of a near palindrom
+ * @brief Normalizes str like pal_check() and counts the characters that would have to be
+ * substituted to make it a palindrom: the mirrored pairs (first and last, second and second to last, ...)
+ * that differ. Counting stops as soon as the count exceeds limit, so a line far from
+ * being a palindrom costs no more than one with limit + 1 mismatches.
+ * @param str string to check
+ * @param len length of str
+ * @param opt options
+ * @param scratch normalization buffer
+ * @param limit mismatches allowed
+ * @return returns the number of mismatches (at most limit + 1), -1 (errno ENOMEM) if the scratch buffer could not grow
+ */
+long pal_mismatches(const char *str, size_t len, const struct pal_options *opt, struct pal_scratch *scratch, size_t limit)
+{
+    if ((str = normalize(str, &len, opt, scratch)) == NULL)
+        return -1;
+
+    return pal_count_mismatches(str, len, opt, limit);
+}
+
+/**
+ * @brief Second step of pal_mismatches(): counts the mismatches of a string
+ * normalized by pal_normalize(), like pal_compare() does for exact palindroms
+ * 
+ * @param str normalized string
+ * @param len length of str
+ * @param opt options
+ * @param limit mismatches allowed
+ * @return number of mismatches, at most limit + 1
+ */
+size_t pal_count_mismatches(const char *str, size_t len, const struct pal_options *opt, size_t limit)
+{
+    size_t n;
+
+    if (opt->utf8 != 0 && is_ascii(str, len) == 0)
+        n = count_mismatches_utf8(str, len, opt->ignore_case, limit);
+    else
+        n = count_mismatches(str, len, opt->table == NULL && opt->ignore_case != 0, limit);
+    return n > limit ? limit + 1 : n;
+}
+
+/**
+ * Checks a DNA sequence
+ * @brief A sequence is a (biological) palindrom if it equals its reverse complement,
+ * like the restriction site GAATTC. The bases are packed into 2 bit codes (A 0, C 1, G 2, T 3,
+ * lower case like upper case) in the scratch buffer, 32 per 64 bit word. Then 32 bases from the
+ * front are compared with the reverse complement of the mirrored 32 bases from the back per step.
+ * @param str sequence
+ * @param len length of str
+ * @param scratch buffer for the packed sequence
+ * @return returns 1 if the sequence is its own reverse complement, 0 if not, PAL_DNA_UNKNOWN if it
+ * contains other bytes than A, C, G and T, -1 (errno ENOMEM) if the scratch buffer could not grow
+ */
+int pal_check_dna(const char *str, size_t len, struct pal_scratch *scratch)
+{
+    size_t words = len / 32 + 2, i, half = len / 2;
+    uint64_t *w;
+
+    if ((w = (uint64_t *)scratch_reserve(scratch, words * sizeof(uint64_t))) == NULL)
+        return -1;
+
+    // the word after the last base is left 0 for base_window()
+    w[(len + 31) / 32] = 0;
+    if (pack_bases(w, str, len) == 0)
+        return PAL_DNA_UNKNOWN;
+    if (len % 2 != 0)
+        return 0; // the middle base can't be its own complement
+
+    // base j of the front half against base len - 1 - j
+    for (i = 0; i < half; i += 32)
+    {
+        size_t n = half - i < 32 ? half - i : 32;
+        uint64_t mask = n == 32 ? ~(uint64_t)0 : ((uint64_t)1 << (2 * n)) - 1;
+        uint64_t back = reverse_complement(base_window(w, len - i - n)) >> (64 - 2 * n);
+
+        if (((w[i / 32] ^ back) & mask) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief reverses the order of the 32 bases of a packed word and complements them
+ * 
+ * @param x packed bases, base 0 in the lowest bits
+ * @return reverse complement of x
+ */
+static uint64_t reverse_complement(uint64_t x)
+{
+    x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    return ~__builtin_bswap64(x);
+}
+
+/**
+ * @brief packs a sequence into 2 bit codes, 32 bases per word, base 0 in the lowest bits
+ * 
+ * @param w receives (len + 31) / 32 words
+ * @param str sequence
+ * @param len length of str
+ * @return 1 if all bytes are bases, 0 if not
+ */
+static int pack_bases_scalar(uint64_t *w, const char *str, size_t len)
+{
+    const unsigned char *s = (const unsigned char *)str;
+    unsigned int valid = 1;
+    size_t i, j;
+
+    for (i = 0; i < len; i += 32)
+    {
+        size_t n = len - i < 32 ? len - i : 32;
+        uint64_t x = 0;
+
+        for (j = 0; j < n; j++)
+        {
+            unsigned int c = s[i + j];
+            valid &= is_base[c];
+            x |= (uint64_t)(((c >> 1) ^ (c >> 2)) & 3) << (2 * j);
+        }
+        w[i / 32] = x;
+    }
+    return valid;
+}
+
+#ifdef HAVE_X86_SIMD
+/**
+ * @brief pack_bases_scalar() 32 bases per step: the bases are validated with four compares,
+ * the codes of neighbouring bytes are merged with maddubs (2 bases per 16 bit) and madd
+ * (4 bases per 32 bit), then the low byte of every dword is gathered into the word.
+ * 
+ * @param w receives (len + 31) / 32 words
+ * @param str sequence
+ * @param len length of str
+ * @return 1 if all bytes are bases, 0 if not
+ */
+__attribute__((target("avx2"))) static int pack_bases_avx2(uint64_t *w, const char *str, size_t len)
+{
+    const __m256i upper = _mm256_set1_epi8((char)0xDF);
+    const __m256i three = _mm256_set1_epi8(3);
+    const __m256i pairs = _mm256_set1_epi16(1 | 4 << 8);
+    const __m256i quads = _mm256_set1_epi32(1 | 16 << 16);
+    const __m256i gather = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                            0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    __m256i bad = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(str + i));
+        __m256i u = _mm256_and_si256(v, upper);
+        __m256i ok = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(u, _mm256_set1_epi8('A')), _mm256_cmpeq_epi8(u, _mm256_set1_epi8('C'))),
+                                     _mm256_or_si256(_mm256_cmpeq_epi8(u, _mm256_set1_epi8('G')), _mm256_cmpeq_epi8(u, _mm256_set1_epi8('T'))));
+        __m256i code = _mm256_and_si256(_mm256_xor_si256(_mm256_srli_epi16(v, 1), _mm256_srli_epi16(v, 2)), three);
+
+        bad = _mm256_or_si256(bad, _mm256_xor_si256(ok, _mm256_set1_epi8(-1)));
+        code = _mm256_madd_epi16(_mm256_maddubs_epi16(code, pairs), quads);
+        code = _mm256_shuffle_epi8(code, gather);
+        w[i / 32] = (uint32_t)_mm256_extract_epi32(code, 0) | (uint64_t)(uint32_t)_mm256_extract_epi32(code, 4) << 32;
+    }
+
+    return _mm256_testz_si256(bad, bad) && pack_bases_scalar(w + i / 32, str + i, len - i);
+}
+#endif
+
+/**
+ * @brief 32 packed bases starting at any base, from two neighbouring words
+ * 
+ * @param w packed sequence, one word more than needed
+ * @param base index of the first base
+ * @return packed bases base..base + 31
+ */
+static uint64_t base_window(const uint64_t *w, size_t base)
+{
+    unsigned int shift = 2 * (base % 32);
+
+    w += base / 32;
+    return shift == 0 ? w[0] : w[0] >> shift | w[1] << (64 - shift);
+}
+
+/**
+ * Finds the longest palindromic substring
+ * @brief Normalizes str into the scratch buffer (ignore_space drops spaces, ignore_case folds case, or the table) while
+ * remembering where every byte came from, then runs Manacher's algorithm on it in O(n).
+ * The substring is mapped back to the original string, so it may contain spaces with ignore_space.
+ * Of several longest substrings the first one is reported.
+ * 
+ * @param str line to search
+ * @param len length of str
+ * @param opt options
+ * @param scratch normalization buffer
+ * @param offset receives the offset of the substring in str
+ * @param length receives the length of the substring in str (0 for an empty line)
+ * @return 1 if the whole (normalized) string is a palindrom, 0 if not, -1 (errno ENOMEM) if the scratch buffer could not grow
+ */
+int pal_longest(const char *str, size_t len, const struct pal_options *opt, struct pal_scratch *scratch, size_t *offset, size_t *length)
+{
+    // an empty line is a palindrom, nothing to reserve (the buffers may still be NULL)
+    if (len == 0)
+    {
+        *offset = 0;
+        *length = 0;
+        return 1;
+    }
+
+    const unsigned char *s = (const unsigned char *)scratch_reserve(scratch, len);
+    size_t *map = scratch_reserve_idx(scratch, 3 * len);
+    if (s == NULL || map == NULL)
+        return -1;
+    size_t *odd = map + len;      // odd[i]: radius (incl. center) of the longest odd palindrom around i
+    size_t *even = map + 2 * len; // even[i]: radius of the longest even palindrom between i - 1 and i
+    size_t i, n = 0, best_start = 0, best_len = 0;
+    long l, r, k;
+
+    for (i = 0; i < len; i++)
+    {
+        unsigned char c = str[i];
+
+        if (opt->table != NULL)
+        {
+            if (opt->table->keep[c] == 0)
+                continue;
+            c = opt->table->map[c];
+        }
+        else
+        {
+            if (opt->ignore_space != 0 && c == ' ')
+                continue;
+            if (opt->ignore_case != 0)
+                c = toupper(c);
+        }
+        scratch->buf[n] = c;
+        map[n++] = i;
+    }
+
+    for (i = 0, l = 0, r = -1; i < n; i++)
+    {
+        k = (long)i > r ? 1 : (long)odd[l + r - i] < r - (long)i + 1 ? (long)odd[l + r - i] : r - (long)i + 1;
+        while ((long)i - k >= 0 && i + k < n && s[i - k] == s[i + k])
+            k++;
+        odd[i] = k--;
+        if ((long)i + k > r)
+        {
+            l = i - k;
+            r = i + k;
+        }
+        if (2 * odd[i] - 1 > best_len)
+        {
+            best_len = 2 * odd[i] - 1;
+            best_start = i - odd[i] + 1;
+        }
+    }
+
+    for (i = 0, l = 0, r = -1; i < n; i++)
+    {
+        k = (long)i > r ? 0 : (long)even[l + r - i + 1] < r - (long)i + 1 ? (long)even[l + r - i + 1] : r - (long)i + 1;
+        while (i + k < n && (long)i - k - 1 >= 0 && s[i + k] == s[i - k - 1])
+            k++;
+        even[i] = k--;
+        if ((long)i + k > r)
+        {
+            l = i - k - 1;
+            r = i + k;
+        }
+        if (2 * even[i] > best_len || (2 * even[i] == best_len && best_len > 0 && i - even[i] < best_start))
+        {
+            best_len = 2 * even[i];
+            best_start = i - even[i];
+        }
+    }
+
+    if (best_len == 0)
+    {
+        *offset = 0;
+        *length = 0;
+    }
+    else
+    {
+        *offset = map[best_start];
+        *length = map[best_start + best_len - 1] + 1 - *offset;
+    }
+    return best_len == n;
+}
+
+/**
+ * @brief Makes sure the scratch buffer can take a normalized string of len bytes
+ * (plus the slack the compaction kernels write past the end).
+ * The buffer grows by doubling, so it is only reallocated O(log n) times per stream.
+ * 
+ * @param scratch scratch buffer
+ * @param len length of the string to be normalized
+ * @return the scratch buffer, NULL (errno ENOMEM) if it could not grow
+ */
+static char *scratch_reserve(struct pal_scratch *scratch, size_t len)
+{
+    size_t need = len + 16;
+
+    if (need > scratch->cap)
+    {
+        size_t newcap = scratch->cap < 256 ? 256 : scratch->cap;
+        while (newcap < need)
+            newcap *= 2;
+
+        char *newptr = realloc(scratch->buf, newcap);
+        if (newptr == NULL)
+        {
+            errno = ENOMEM;
+            return NULL;
+        }
+        scratch->allocated += newcap - scratch->cap;
+        scratch->buf = newptr;
+        scratch->cap = newcap;
+    }
+    return scratch->buf;
+}
+
+/**
+ * @brief Makes sure the index array of the scratch buffer has room for n entries.
+ * Grows by doubling like scratch_reserve().
+ * 
+ * @param scratch scratch buffer
+ * @param n number of entries
+ * @return the index array, NULL (errno ENOMEM) if it could not grow
+ */
+static size_t *scratch_reserve_idx(struct pal_scratch *scratch, size_t n)
+{
+    if (n > scratch->idx_cap)
+    {
+        size_t newcap = scratch->idx_cap < 256 ? 256 : scratch->idx_cap;
+        while (newcap < n)
+            newcap *= 2;
+
+        size_t *newptr = realloc(scratch->idx, newcap * sizeof(*newptr));
+        if (newptr == NULL)
+        {
+            errno = ENOMEM;
+            return NULL;
+        }
+        scratch->allocated += (newcap - scratch->idx_cap) * sizeof(*newptr);
+        scratch->idx = newptr;
+        scratch->idx_cap = newcap;
+    }
+    return scratch->idx;
+}
+
+/**
+ * @brief Normalizes str for a comparison: into the scratch buffer through the table
+ * or without spaces (ignore_space), otherwise str is used in place.
+ * 
+ * @param str string to normalize
+ * @param len length of str, receives the normalized length
+ * @param opt options
+ * @param scratch normalization buffer
+ * @return the normalized string, NULL (errno ENOMEM) if the scratch buffer could not grow
+ */
+static const char *normalize(const char *str, size_t *len, const struct pal_options *opt, struct pal_scratch *scratch)
+{
+    char *d;
+
+    if (opt->table == NULL && opt->ignore_space == 0)
+        return str;
+    if ((d = scratch_reserve(scratch, *len)) == NULL)
+        return NULL;
+    *len = pal_normalize(d, str, *len, opt);
+    return d;
+}
+
+/**
+ * Builds a normalization table
+ * @brief Combines the rules (PAL_IGNORE_*, PAL_FOLD_CASE) into one table, so that
+ * a string is normalized in a single pass however many rules are given.
+ * Non ASCII bytes are always kept unchanged.
+ * @param table table to fill
+ * @param rules PAL_IGNORE_* and PAL_FOLD_CASE flags
+ */
+void pal_table_init(struct pal_table *table, unsigned int rules)
+{
+    int c;
+
+    memset(table->skip, 0, sizeof(table->skip));
+    table->fold = (rules & PAL_FOLD_CASE) != 0;
+    for (c = 0; c < 256; c++)
+    {
+        int ignore = ((rules & PAL_IGNORE_BLANK) != 0 && c == ' ') ||
+                     ((rules & PAL_IGNORE_NEWLINE) != 0 && c == '\n') ||
+                     ((rules & PAL_IGNORE_SPACE) != 0 && c < 0x80 && isspace(c)) ||
+                     ((rules & PAL_IGNORE_PUNCT) != 0 && c < 0x80 && ispunct(c)) ||
+                     ((rules & PAL_IGNORE_DIGITS) != 0 && c >= '0' && c <= '9');
+
+        table->map[c] = table->fold != 0 && c >= 'a' && c <= 'z' ? c - ('a' - 'A') : c;
+        table->keep[c] = !ignore;
+        if (ignore)
+            table->skip[c & 0x0F] |= 1 << (c >> 4);
+    }
+}
+
+/**
+ * @brief Grows a scratch buffer up front for strings of up to len bytes,
+ * so that pal_check() and pal_check_batch() don't allocate for them.
+ * 
+ * @param scratch scratch buffer
+ * @param len length of the longest string
+ * @return returns 0 on success, -1 (errno ENOMEM) if the buffer could not grow
+ */
+int pal_scratch_reserve(struct pal_scratch *scratch, size_t len)
+{
+    return scratch_reserve(scratch, len) == NULL ? -1 : 0;
+}
+
+/**
+ * @brief Frees the buffers of a scratch buffer (the allocated counter is kept)
+ * 
+ * @param scratch scratch buffer
+ */
+void pal_scratch_free(struct pal_scratch *scratch)
+{
+    free(scratch->buf);
+    free(scratch->idx);
+    scratch->buf = NULL;
+    scratch->idx = NULL;
+    scratch->cap = 0;
+    scratch->idx_cap = 0;
+}
+
+#ifdef HAVE_X86_SIMD
+/**
+ * @brief Chooses the fastest compaction and comparison kernels the cpu supports.
+ * Runs as a constructor, so the kernel pointers never change while checks run.
+ */
+static void select_kernels(void)
+{
+    int m, b, k;
+    for (m = 0; m < 256; m++)
+    {
+        for (b = 0, k = 0; b < 8; b++)
+        {
+            if (m & (1 << b))
+                pack_lut[m][k++] = b;
+        }
+        for (; k < 8; k++)
+            pack_lut[m][k] = 0x80;
+    }
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        compare_mirrored = compare_mirrored_avx2;
+        count_mismatches = count_mismatches_avx2;
+        is_ascii = is_ascii_avx2;
+        pack_bases = pack_bases_avx2;
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        compare_mirrored = compare_mirrored_sse2;
+        count_mismatches = count_mismatches_sse2;
+        is_ascii = is_ascii_sse2;
+    }
+    if (__builtin_cpu_supports("ssse3"))
+    {
+        compact_spaces = compact_spaces_ssse3;
+        translate = translate_ssse3;
+    }
+}
+#endif
+
+/**
+ * @brief copies src to dst without spaces
+ * 
+ * @param dst destination buffer
+ * @param src input string
+ * @param len length of src
+ * @return length of dst
+ */
+static size_t compact_spaces_scalar(char *dst, const char *src, size_t len)
+{
+    size_t i, n = 0;
+
+    for (i = 0; i < len; i++)
+    {
+        if (src[i] != ' ')
+            dst[n++] = src[i];
+    }
+    return n;
+}
+
+/**
+ * @brief copies src to dst through a normalization table, branch free:
+ * every byte is stored and the write position only advances for kept bytes
+ * 
+ * @param dst destination buffer (len bytes)
+ * @param src input string
+ * @param len length of src
+ * @param table normalization table
+ * @return length of dst
+ */
+static size_t translate_scalar(char *dst, const char *src, size_t len, const struct pal_table *table)
+{
+    size_t i, n = 0;
+
+    for (i = 0; i < len; i++)
+    {
+        unsigned char c = src[i];
+        dst[n] = table->map[c];
+        n += table->keep[c];
+    }
+    return n;
+}
+
+/**
+ * @brief compares str from both ends byte by byte
+ * 
+ * @param str input string
+ * @param len length of str
+ * @param fold compare case insensitive if not 0
+ * @return 1 if str is a palindrom, 0 if not
+ */
+static int compare_mirrored_scalar(const char *str, size_t len, int fold)
+{
+    const unsigned char *start = (const unsigned char *)str;
+    const unsigned char *end = start + len;
+
+    while (start + 1 < end)
+    {
+        end--;
+        if (fold != 0 ? toupper(*start) != toupper(*end) : *start != *end)
+            return 0;
+        start++;
+    }
+    return 1;
+}
+
+/**
+ * @brief counts the mirrored byte pairs of str that differ
+ * 
+ * @param str input string
+ * @param len length of str
+ * @param fold compare case insensitive if not 0
+ * @param limit stop counting after limit + 1 mismatches
+ * @return number of mismatches, at most limit + 1
+ */
+static size_t count_mismatches_scalar(const char *str, size_t len, int fold, size_t limit)
+{
+    const unsigned char *start = (const unsigned char *)str;
+    const unsigned char *end = start + len;
+    size_t n = 0;
+
+    while (start + 1 < end)
+    {
+        end--;
+        if ((fold != 0 ? toupper(*start) != toupper(*end) : *start != *end) && ++n > limit)
+            break;
+        start++;
+    }
+    return n;
+}
+
+#ifdef HAVE_X86_SIMD
+/**
+ * @brief copies src to dst without spaces, 16 bytes at a time
+ * Each half of a block is left-packed with pshufb using pack_lut and stored
+ * with an 8 byte store, so dst may be written up to 16 bytes past its end.
+ * 
+ * @param dst destination buffer (len + 16 bytes)
+ * @param src input string
+ * @param len length of src
+ * @return length of dst
+ */
+__attribute__((target("ssse3"))) static size_t compact_spaces_ssse3(char *dst, const char *src, size_t len)
+{
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i hi_offset = _mm_set_epi8(8, 8, 8, 8, 8, 8, 8, 8, 0, 0, 0, 0, 0, 0, 0, 0);
+    char *d = dst;
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        unsigned int keep = ~_mm_movemask_epi8(_mm_cmpeq_epi8(v, space)) & 0xFFFF;
+        unsigned int lo = keep & 0xFF, hi = keep >> 8;
+
+        __m128i ctrl = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)pack_lut[lo]),
+                                          _mm_loadl_epi64((const __m128i *)pack_lut[hi]));
+        v = _mm_shuffle_epi8(v, _mm_add_epi8(ctrl, hi_offset));
+
+        _mm_storel_epi64((__m128i *)d, v);
+        d += __builtin_popcount(lo);
+        _mm_storel_epi64((__m128i *)d, _mm_srli_si128(v, 8));
+        d += __builtin_popcount(hi);
+    }
+
+    return (d - dst) + compact_spaces_scalar(d, src + i, len - i);
+}
+
+/**
+ * @brief converts 'a'..'z' to 'A'..'Z' in all 16 bytes of v
+ */
+__attribute__((target("sse2"))) static inline __m128i fold_sse2(__m128i v)
+{
+    __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1)));
+    return _mm_sub_epi8(v, _mm_and_si128(lower, _mm_set1_epi8(0x20)));
+}
+
+/**
+ * @brief translate() 16 bytes at a time, like compact_spaces_ssse3().
+ * A byte is dropped if bit (byte >> 4) of skip[byte & 15] is set: two pshufb lookups,
+ * one for the low nibble in skip and one for the bit of the high nibble (0 for non ASCII bytes).
+ * The kept bytes are folded with fold_sse2() and left-packed.
+ * 
+ * @param dst destination buffer (len + 16 bytes)
+ * @param src input string
+ * @param len length of src
+ * @param table normalization table
+ * @return length of dst
+ */
+__attribute__((target("ssse3"))) static size_t translate_ssse3(char *dst, const char *src, size_t len, const struct pal_table *table)
+{
+    const __m128i skip = _mm_loadu_si128((const __m128i *)table->skip);
+    const __m128i bit = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, (char)128, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i hi_offset = _mm_set_epi8(8, 8, 8, 8, 8, 8, 8, 8, 0, 0, 0, 0, 0, 0, 0, 0);
+    char *d = dst;
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i lo = _mm_shuffle_epi8(skip, _mm_and_si128(v, nibble));
+        __m128i hi = _mm_shuffle_epi8(bit, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+        __m128i drop = _mm_and_si128(lo, hi);
+        unsigned int keep = _mm_movemask_epi8(_mm_cmpeq_epi8(drop, _mm_setzero_si128()));
+        unsigned int klo = keep & 0xFF, khi = keep >> 8;
+
+        if (table->fold != 0)
+            v = fold_sse2(v);
+        __m128i ctrl = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)pack_lut[klo]),
+                                          _mm_loadl_epi64((const __m128i *)pack_lut[khi]));
+        v = _mm_shuffle_epi8(v, _mm_add_epi8(ctrl, hi_offset));
+
+        _mm_storel_epi64((__m128i *)d, v);
+        d += __builtin_popcount(klo);
+        _mm_storel_epi64((__m128i *)d, _mm_srli_si128(v, 8));
+        d += __builtin_popcount(khi);
+    }
+
+    return (d - dst) + translate_scalar(d, src + i, len - i, table);
+}
+
+/**
+ * @brief compares str from both ends, 16 bytes per step
+ * The back block is byte reversed with word/dword shuffles (SSE2 has no pshufb).
+ * 
+ * @param str input string
+ * @param len length of str
+ * @param fold compare case insensitive if not 0
+ * @return 1 if str is a palindrom, 0 if not
+ */
+__attribute__((target("sse2"))) static int compare_mirrored_sse2(const char *str, size_t len, int fold)
+{
+    size_t i = 0, j = len;
+
+    for (; j - i >= 32; i += 16, j -= 16)
+    {
+        __m128i front = _mm_loadu_si128((const __m128i *)(str + i));
+        __m128i back = _mm_loadu_si128((const __m128i *)(str + j - 16));
+
+        back = _mm_shuffle_epi32(back, _MM_SHUFFLE(0, 1, 2, 3));
+        back = _mm_shufflelo_epi16(back, _MM_SHUFFLE(2, 3, 0, 1));
+        back = _mm_shufflehi_epi16(back, _MM_SHUFFLE(2, 3, 0, 1));
+        back = _mm_or_si128(_mm_slli_epi16(back, 8), _mm_srli_epi16(back, 8));
+
+        if (fold != 0)
+        {
+            front = fold_sse2(front);
+            back = fold_sse2(back);
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(front, back)) != 0xFFFF)
+            return 0;
+    }
+
+    return compare_mirrored_scalar(str + i, j - i, fold);
+}
+
+/**
+ * @brief counts the mirrored byte pairs of str that differ, 16 pairs per step:
+ * the blocks are compared like in compare_mirrored_sse2() and the mismatch mask is popcounted
+ * 
+ * @param str input string
+ * @param len length of str
+ * @param fold compare case insensitive if not 0
+ * @param limit stop counting after limit + 1 mismatches
+ * @return number of mismatches, more than limit if counting stopped early (a block is counted as a whole)
+ */
+__attribute__((target("sse2"))) static size_t count_mismatches_sse2(const char *str, size_t len, int fold, size_t limit)
+{
+    size_t i = 0, j = len, n = 0;
+
+    for (; j - i >= 32; i += 16, j -= 16)
+    {
+        __m128i front = _mm_loadu_si128((const __m128i *)(str + i));
+        __m128i back = _mm_loadu_si128((const __m128i *)(str + j - 16));
+        unsigned int ne;
+
+        back = _mm_shuffle_epi32(back, _MM_SHUFFLE(0, 1, 2, 3));
+        back = _mm_shufflelo_epi16(back, _MM_SHUFFLE(2, 3, 0, 1));
+        back = _mm_shufflehi_epi16(back, _MM_SHUFFLE(2, 3, 0, 1));
+        back = _mm_or_si128(_mm_slli_epi16(back, 8), _mm_srli_epi16(back, 8));
+
+        if (fold != 0)
+        {
+            front = fold_sse2(front);
+            back = fold_sse2(back);
+        }
+        ne = ~_mm_movemask_epi8(_mm_cmpeq_epi8(front, back)) & 0xFFFF;
+        if (ne != 0 && (n += __builtin_popcount(ne)) > limit)
+            return n;
+    }
+
+    return n + count_mismatches_scalar(str + i, j - i, fold, limit - n);
+}
+
+/**
+ * @brief converts 'a'..'z' to 'A'..'Z' in all 32 bytes of v
+ */
+__attribute__((target("avx2"))) static inline __m256i fold_avx2(__m256i v)
+{
+    __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('a' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), v));
+    return _mm256_sub_epi8(v, _mm256_and_si256(lower, _mm256_set1_epi8(0x20)));
+}
+
+/**
+ * @brief compares str from both ends, 32 bytes per step
+ * The back block is byte reversed with pshufb inside each lane and a lane swap.
+ * 
+ * @param str input string
+ * @param len length of str
+ * @param fold compare case insensitive if not 0
+ * @return 1 if str is a palindrom, 0 if not
+ */
+__attribute__((target("avx2"))) static int compare_mirrored_avx2(const char *str, size_t len, int fold)
+{
+    const __m256i reverse = _mm256_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                                            0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    size_t i = 0, j = len;
+
+    for (; j - i >= 64; i += 32, j -= 32)
+    {
+        __m256i front = _mm256_loadu_si256((const __m256i *)(str + i));
+        __m256i back = _mm256_loadu_si256((const __m256i *)(str + j - 32));
+
+        back = _mm256_shuffle_epi8(back, reverse);
+        back = _mm256_permute2x128_si256(back, back, 1);
+
+        if (fold != 0)
+        {
+            front = fold_avx2(front);
+            back = fold_avx2(back);
+        }
+        if ((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(front, back)) != 0xFFFFFFFFu)
+            return 0;
+    }
+
+    return compare_mirrored_sse2(str + i, j - i, fold);
+}
+
+/**
+ * @brief counts the mirrored byte pairs of str that differ, 32 pairs per step
+ * 
+ * @param str input string
+ * @param len length of str
+ * @param fold compare case insensitive if not 0
+ * @param limit stop counting after limit + 1 mismatches
+ * @return number of mismatches, more than limit if counting stopped early (a block is counted as a whole)
+ */
+__attribute__((target("avx2"))) static size_t count_mismatches_avx2(const char *str, size_t len, int fold, size_t limit)
+{
+    const __m256i reverse = _mm256_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                                            0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    size_t i = 0, j = len, n = 0;
+
+    for (; j - i >= 64; i += 32, j -= 32)
+    {
+        __m256i front = _mm256_loadu_si256((const __m256i *)(str + i));
+        __m256i back = _mm256_loadu_si256((const __m256i *)(str + j - 32));
+        unsigned int ne;
+
+        back = _mm256_shuffle_epi8(back, reverse);
+        back = _mm256_permute2x128_si256(back, back, 1);
+
+        if (fold != 0)
+        {
+            front = fold_avx2(front);
+            back = fold_avx2(back);
+        }
+        ne = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(front, back));
+        if (ne != 0 && (n += __builtin_popcount(ne)) > limit)
+            return n;
+    }
+
+    return n + count_mismatches_sse2(str + i, j - i, fold, limit - n);
+}
+
+/**
+ * @brief checks if no byte of str has the high bit set, 16 bytes per step
+ * 
+ * @param str input string
+ * @param len length of str
+ * @return 1 if str is pure ASCII, 0 if not
+ */
+__attribute__((target("sse2"))) static int is_ascii_sse2(const char *str, size_t len)
+{
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+        acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i *)(str + i)));
+
+    return _mm_movemask_epi8(acc) == 0 && is_ascii_scalar(str + i, len - i);
+}
+
+/**
+ * @brief checks if no byte of str has the high bit set, 32 bytes per step
+ * 
+ * @param str input string
+ * @param len length of str
+ * @return 1 if str is pure ASCII, 0 if not
+ */
+__attribute__((target("avx2"))) static int is_ascii_avx2(const char *str, size_t len)
+{
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32)
+        acc = _mm256_or_si256(acc, _mm256_loadu_si256((const __m256i *)(str + i)));
+
+    return _mm256_movemask_epi8(acc) == 0 && is_ascii_sse2(str + i, len - i);
+}
+#endif
+
+/**
+ * @brief checks if no byte of str has the high bit set
+ * 
+ * @param str input string
+ * @param len length of str
+ * @return 1 if str is pure ASCII, 0 if not
+ */
+static int is_ascii_scalar(const char *str, size_t len)
+{
+    unsigned char acc = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        acc |= (unsigned char)str[i];
+    return (acc & 0x80) == 0;
+}
+
+/**
+ * simple case folding (CaseFolding.txt status C and S) for the common alphabets,
+ * sorted by lo for the binary search in fold_code_point()
+ */
+static const struct fold_range fold_table[] = {
+    {0x0041, 0x005A, 32, 1},    // Basic Latin
+    {0x00B5, 0x00B5, 775, 1},   // micro sign -> greek mu
+    {0x00C0, 0x00D6, 32, 1},    // Latin-1
+    {0x00D8, 0x00DE, 32, 1},
+    {0x0100, 0x012F, 1, 2},     // Latin Extended-A
+    {0x0132, 0x0137, 1, 2},
+    {0x0139, 0x0148, 1, 2},
+    {0x014A, 0x0177, 1, 2},
+    {0x0178, 0x0178, -121, 1},
+    {0x0179, 0x017E, 1, 2},
+    {0x017F, 0x017F, -268, 1},  // long s
+    {0x01CD, 0x01DC, 1, 2},     // Latin Extended-B (regular part)
+    {0x01DE, 0x01EF, 1, 2},
+    {0x01F8, 0x021F, 1, 2},
+    {0x0222, 0x0233, 1, 2},
+    {0x0386, 0x0386, 38, 1},    // Greek
+    {0x0388, 0x038A, 37, 1},
+    {0x038C, 0x038C, 64, 1},
+    {0x038E, 0x038F, 63, 1},
+    {0x0391, 0x03A1, 32, 1},
+    {0x03A3, 0x03AB, 32, 1},
+    {0x03C2, 0x03C2, 1, 1},     // final sigma
+    {0x03D8, 0x03EF, 1, 2},
+    {0x0400, 0x040F, 80, 1},    // Cyrillic
+    {0x0410, 0x042F, 32, 1},
+    {0x0460, 0x0481, 1, 2},
+    {0x048A, 0x04BF, 1, 2},
+    {0x04C0, 0x04C0, 15, 1},
+    {0x04C1, 0x04CE, 1, 2},
+    {0x04D0, 0x052F, 1, 2},
+    {0x0531, 0x0556, 48, 1},    // Armenian
+    {0x1E00, 0x1E95, 1, 2},     // Latin Extended Additional
+    {0x1E9E, 0x1E9E, -7615, 1}, // capital sharp s
+    {0x1EA0, 0x1EFF, 1, 2},
+    {0xFF21, 0xFF3A, 32, 1},    // fullwidth Latin
+    {0x10400, 0x10427, 40, 1},  // Deseret
+};
+
+/**
+ * @brief folds a code point with fold_table
+ * 
+ * @param cp code point
+ * @return folded code point (cp itself if it has no folding)
+ */
+static unsigned int fold_code_point(unsigned int cp)
+{
+    size_t lo = 0, hi = sizeof(fold_table) / sizeof(fold_table[0]);
+
+    if (cp < 0x80)
+        return cp >= 'A' && cp <= 'Z' ? cp + 32 : cp;
+
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        const struct fold_range *r = &fold_table[mid];
+
+        if (cp < r->lo)
+            hi = mid;
+        else if (cp > r->hi)
+            lo = mid + 1;
+        else
+            return (cp - r->lo) % r->stride == 0 ? cp + r->delta : cp;
+    }
+    return cp;
+}
+
+/**
+ * @brief decodes the UTF-8 sequence at the start of s.
+ * Invalid or truncated sequences decode one byte b as 0xDC00 + b (like Python's
+ * surrogateescape), so every byte string has exactly one decoding.
+ * 
+ * @param s input bytes
+ * @param len number of bytes available (> 0)
+ * @param n receives the length of the sequence
+ * @return code point
+ */
+static unsigned int utf8_next(const unsigned char *s, size_t len, size_t *n)
+{
+    unsigned int cp, min;
+    size_t need, i;
+
+    if (s[0] < 0x80)
+    {
+        *n = 1;
+        return s[0];
+    }
+    else if (s[0] >= 0xC2 && s[0] <= 0xDF)
+    {
+        need = 2;
+        cp = s[0] & 0x1F;
+        min = 0x80;
+    }
+    else if (s[0] >= 0xE0 && s[0] <= 0xEF)
+    {
+        need = 3;
+        cp = s[0] & 0x0F;
+        min = 0x800;
+    }
+    else if (s[0] >= 0xF0 && s[0] <= 0xF4)
+    {
+        need = 4;
+        cp = s[0] & 0x07;
+        min = 0x10000;
+    }
+    else
+    {
+        *n = 1;
+        return 0xDC00 + s[0];
+    }
+
+    if (len < need)
+    {
+        *n = 1;
+        return 0xDC00 + s[0];
+    }
+    for (i = 1; i < need; i++)
+    {
+        if ((s[i] & 0xC0) != 0x80)
+        {
+            *n = 1;
+            return 0xDC00 + s[0];
+        }
+        cp = (cp << 6) | (s[i] & 0x3F);
+    }
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+    {
+        *n = 1;
+        return 0xDC00 + s[0];
+    }
+
+    *n = need;
+    return cp;
+}
+
+/**
+ * @brief decodes the UTF-8 sequence that ends at s + len.
+ * Steps back over at most three continuation bytes and accepts the sequence only if
+ * utf8_next() decodes it to exactly that end, so both directions split a string the same way.
+ * 
+ * @param s input bytes
+ * @param len number of bytes before the end (> 0)
+ * @param n receives the length of the sequence
+ * @return code point
+ */
+static unsigned int utf8_prev(const unsigned char *s, size_t len, size_t *n)
+{
+    size_t back;
+
+    for (back = 1; back <= 4 && back <= len; back++)
+    {
+        unsigned char c = s[len - back];
+        if ((c & 0xC0) != 0x80)
+        {
+            unsigned int cp = utf8_next(s + len - back, back, n);
+            if (*n == back)
+                return cp;
+            break;
+        }
+    }
+
+    *n = 1;
+    return s[len - 1] < 0x80 ? s[len - 1] : 0xDC00 + s[len - 1];
+}
+
+/**
+ * @brief compares a UTF-8 string from both ends by code point and counts the pairs that differ
+ * 
+ * @param str input string
+ * @param len length of str
+ * @param fold compare with simple case folding if not 0
+ * @param limit stop counting after limit + 1 mismatches
+ * @return number of mismatches, at most limit + 1 (0 if str is a palindrom)
+ */
+static size_t count_mismatches_utf8(const char *str, size_t len, int fold, size_t limit)
+{
+    const unsigned char *s = (const unsigned char *)str;
+    size_t start = 0, end = len, n = 0;
+
+    for (;;)
+    {
+        unsigned int a, b;
+        size_t na, nb;
+
+        if (start >= end)
+            return n;
+
+        a = utf8_next(s + start, end - start, &na);
+        b = utf8_prev(s + start, end - start, &nb);
+        if (start + na > end - nb)
+            return n; // the same code point in the middle
+
+        if (fold != 0)
+        {
+            a = fold_code_point(a);
+            b = fold_code_point(b);
+        }
+        if (a != b && ++n > limit)
+            return n;
+        start += na;
+        end -= nb;
+    }
+}
@@ -0,0 +1,90 @@
+/**
+ * @file palindrome.h
+ * @date 16.10.2026
+ *
+ * @brief Palindrom checking library (libpalindrome.a).
+ * Strings are (pointer, length) views and don't need a '\0'. Every function
+ * takes a caller owned scratch buffer: one per thread, reused for all calls.
+ * Functions that can grow the scratch buffer return -1 and set errno to ENOMEM
+ * if that fails, nothing else is allocated.
+ **/
+#ifndef PALINDROME_H
+#define PALINDROME_H
+
+#include <stddef.h>
+
+// pal_check_dna() result for a sequence with other bases than A, C, G and T (e.g. N)
+#define PAL_DNA_UNKNOWN 2
+
+/**
+ * Normalization rules of pal_table_init()
+ */
+#define PAL_IGNORE_BLANK 0x01  // ' '
+#define PAL_IGNORE_SPACE 0x02  // all white space (' ', '\t', '\n', '\v', '\f', '\r')
+#define PAL_IGNORE_PUNCT 0x04  // ASCII punctuation
+#define PAL_IGNORE_DIGITS 0x08 // '0'..'9'
+#define PAL_FOLD_CASE 0x10     // 'a'..'z' to 'A'..'Z'
+#define PAL_IGNORE_NEWLINE 0x20 // '\n' (for checks across lines)
+
+/**
+ * Byte normalization table built by pal_table_init(): every byte c of a string
+ * is replaced by map[c] and dropped if keep[c] is 0, all rules in one pass.
+ * skip and fold hold the same rules for the SIMD kernel.
+ */
+struct pal_table
+{
+    unsigned char map[256];
+    unsigned char keep[256];
+    unsigned char skip[16]; // bit h of skip[l] is set if the ASCII byte h * 16 + l is dropped
+    int fold;               // map folds 'a'..'z'
+};
+
+/**
+ * What a check ignores (all 0: bytes must match exactly)
+ */
+struct pal_options
+{
+    int ignore_case;  // fold ASCII case (simple Unicode case folding with utf8)
+    int ignore_space; // skip ' '
+    int utf8;         // compare strings with non ASCII bytes by code point
+    const struct pal_table *table; // if not NULL, normalizes bytes instead of ignore_case and ignore_space
+};
+
+/**
+ * A string to check
+ */
+struct pal_view
+{
+    const char *data;
+    size_t len;
+};
+
+/**
+ * Normalization buffer reused for all strings checked by one thread.
+ * It only grows (geometrically), so steady state checking does not touch the heap.
+ * Initialize with PAL_SCRATCH_INIT, release with pal_scratch_free().
+ */
+struct pal_scratch
+{
+    char *buf;
+    size_t cap;
+    size_t *idx; // position map and radii for pal_longest()
+    size_t idx_cap;
+    size_t allocated; // bytes allocated over the lifetime of the buffer
+};
+
+#define PAL_SCRATCH_INIT {NULL, 0, NULL, 0, 0}
+
+int pal_check(const char *str, size_t len, const struct pal_options *opt, struct pal_scratch *scratch);
+long pal_check_batch(const struct pal_view *views, size_t n, const struct pal_options *opt, struct pal_scratch *scratch, unsigned char *verdicts);
+size_t pal_normalize(char *dst, const char *str, size_t len, const struct pal_options *opt);
+int pal_compare(const char *str, size_t len, const struct pal_options *opt);
+long pal_mismatches(const char *str, size_t len, const struct pal_options *opt, struct pal_scratch *scratch, size_t limit);
+size_t pal_count_mismatches(const char *str, size_t len, const struct pal_options *opt, size_t limit);
+int pal_check_dna(const char *str, size_t len, struct pal_scratch *scratch);
+int pal_longest(const char *str, size_t len, const struct pal_options *opt, struct pal_scratch *scratch, size_t *offset, size_t *length);
+int pal_scratch_reserve(struct pal_scratch *scratch, size_t len);
+void pal_scratch_free(struct pal_scratch *scratch);
+void pal_table_init(struct pal_table *table, unsigned int rules);
+
+#endif
@@ -1,118 +1,312 @@
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
 #include <fcntl.h>
+#include <time.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
-#include <semaphore.h>
-#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include <unistd.h>
 #include "error.h"
 #include "graph.h"
 #include "circular_buffer.h"
 
 #define SHM_NAME "/bufshm"
-#define SEM_USED "/used"
-#define SEM_FREE "/free"
-#define SEM_RES "/res"
+
+// spin rounds before sleeping on the futex, adapted per thread between these bounds
+// (no spinning with a single CPU, the other side can't make progress meanwhile)
+#define SPIN_MIN (16)
+#define SPIN_MAX (4096)
+
+// freed slots before the reader wakes the writers sleeping on a full buffer
+#define WAKE_BATCH (MAX_DATA / 4)
+
+// get_buffer() waits up to 100 * 10ms for the supervisor to initialize the buffer
+#define READY_TRIES (100)
 
 struct bufshm *bufshm;
 int shmfd, created_buf = 0;
-sem_t *s_used, *s_free, *s_res;
+static unsigned int spin_max;
 
+static void close_shm(void);
+static struct bufshm *get_shm(int create);
+static void init_spin(void);
+static int wait_word(atomic_uint *word, unsigned int old, atomic_uint *waiters);
+static void wake_word(atomic_uint *word, atomic_uint *waiters, int n);
+static void cpu_relax(void);
+
+/**
+ * @brief creates the buffer (supervisor): all slots free for the first round
+ */
 void init_buf(void)
 {
+    unsigned int i;
+
     created_buf = 1;
-    s_used = sem_open(SEM_USED, O_CREAT | O_EXCL, 0600, 0);
-    s_free = sem_open(SEM_FREE, O_CREAT | O_EXCL, 0600, MAX_DATA);
-    s_res = sem_open(SEM_RES, O_CREAT | O_EXCL, 0600, 1);
+    init_spin();
+    bufshm = get_shm(1);
+    atomic_store(&bufshm->ready, 0); // left over from a supervisor that crashed
+    atomic_store(&bufshm->wr_pos, 0);
+    bufshm->rd_pos = 0;
+    atomic_store(&bufshm->quit, 0);
+    atomic_store(&bufshm->reader_waiting, 0);
+    atomic_store(&bufshm->freed, 0);
+    atomic_store(&bufshm->writers_waiting, 0);
+    for (i = 0; i < MAX_DATA; i++)
+        atomic_store(&bufshm->buf[i].seq, i);
+    atomic_store_explicit(&bufshm->ready, 1, memory_order_release);
+}
 
-    if (s_used == SEM_FAILED || s_free == SEM_FAILED || s_res == SEM_FAILED)
+/**
+ * @brief opens the buffer of the supervisor (generator), waits a moment if
+ * the supervisor did not initialize it yet
+ */
+void get_buffer(void)
+{
+    struct timespec pause = {0, 10000000};
+    int i;
+
+    init_spin();
+    for (i = 0; i < READY_TRIES; i++)
     {
-        close_shm_sem();
-        ERROR_MSG("failed to create semaphores", "");
+        if ((bufshm = get_shm(0)) != NULL)
+        {
+            if (atomic_load_explicit(&bufshm->ready, memory_order_acquire))
+                return;
+            close_shm();
+        }
+        nanosleep(&pause, NULL);
     }
+    ERROR_MSG("circular buffer not ready", "");
+}
 
-    bufshm = get_shm();
+/**
+ * @brief closes the buffer. The supervisor (creator) tells the generators to
+ * stop, wakes the ones waiting for a free slot and unlinks the shared memory.
+ */
+void close_all(void)
+{
+    if (created_buf)
+    {
+        atomic_store(&bufshm->quit, 1);
+        atomic_fetch_add(&bufshm->freed, 1);
+        wake_word(&bufshm->freed, &bufshm->writers_waiting, INT_MAX);
+        close_shm();
+        shm_unlink(SHM_NAME);
+    }
+    else
+        close_shm();
 }
 
-void get_buffer(void)
+/**
+ * @brief writes an arcset into the buffer, blocks while the buffer is full.
+ * Lock free: a writer claims a position by CAS on wr_pos, fills the slot and
+ * publishes it with the slot's sequence number. Thread and process safe.
+ *
+ * @param edges arcset [from1, to1, ...]
+ * @param n edges, at most MAX_ARCS
+ * @return int 0 on success, -1 if interrupted (by a signal) or the supervisor quit
+ */
+int write_buf(const int *edges, unsigned int n)
 {
-    s_used = sem_open(SEM_USED, 0);
-    s_free = sem_open(SEM_FREE, MAX_DATA);
-    s_res = sem_open(SEM_RES, 1);
+    unsigned int pos = atomic_load_explicit(&bufshm->wr_pos, memory_order_relaxed);
+    struct slot *slot;
 
-    if (s_used == SEM_FAILED || s_free == SEM_FAILED || s_res == SEM_FAILED)
+    for (;;)
     {
-        close_shm_sem();
-        ERROR_MSG("failed to open sem", "");
+        unsigned int seq;
+        int diff;
+
+        if (atomic_load_explicit(&bufshm->quit, memory_order_relaxed))
+            return -1;
+        slot = &bufshm->buf[pos % MAX_DATA];
+        seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        diff = (int)(seq - pos);
+
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&bufshm->wr_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // full: the slot still holds the arcset of the last round.
+            // freed is read before seq again, so a slot freed in between changes it
+            unsigned int freed = atomic_load(&bufshm->freed);
+            if (atomic_load(&slot->seq) == seq && wait_word(&bufshm->freed, freed, &bufshm->writers_waiting) == -1)
+                return -1;
+            pos = atomic_load_explicit(&bufshm->wr_pos, memory_order_relaxed);
+        }
+        else
+            pos = atomic_load_explicit(&bufshm->wr_pos, memory_order_relaxed);
     }
 
-    bufshm = get_shm();
+    slot->s.n = n;
+    memcpy(slot->s.edges, edges, sizeof(int) * 2 * n);
+    atomic_store(&slot->seq, pos + 1);
+    wake_word(&slot->seq, &bufshm->reader_waiting, 1);
+    return 0;
 }
 
-void close_all(void)
+/**
+ * @brief reads the next arcset from the buffer, blocks while the buffer is empty
+ *
+ * @param s receives the arcset
+ * @return int 0 on success, -1 if interrupted (by a signal)
+ */
+int read_buf(struct solution *s)
 {
-    if (created_buf)
-        close_shm_sem_unlink();
-    else
-        close_shm_sem();
+    unsigned int pos = bufshm->rd_pos;
+    struct slot *slot = &bufshm->buf[pos % MAX_DATA];
+    unsigned int seq;
+
+    while ((seq = atomic_load_explicit(&slot->seq, memory_order_acquire)) != pos + 1)
+    {
+        // never sleep while writers sleep on slots freed since the last batch
+        wake_word(&bufshm->freed, &bufshm->writers_waiting, INT_MAX);
+        if (wait_word(&slot->seq, seq, &bufshm->reader_waiting) == -1)
+            return -1;
+    }
+    *s = slot->s;
+    bufshm->rd_pos = pos + 1;
+    atomic_store(&slot->seq, pos + MAX_DATA);
+
+    // sleeping writers are woken in batches of WAKE_BATCH freed slots, not one system call per slot
+    atomic_fetch_add(&bufshm->freed, 1);
+    if ((pos + 1) % WAKE_BATCH == 0)
+        wake_word(&bufshm->freed, &bufshm->writers_waiting, INT_MAX);
+    return 0;
 }
 
-void write_buf(graph_t *g)
+/**
+ * @brief tells if the supervisor wants the generators to stop
+ *
+ * @return int not 0 to stop
+ */
+int buf_quit(void)
 {
-    sem_wait(s_res);
-    sem_wait(s_free);
-    struct bufshm *bufshm = get_buf();
-    bufshm->buf[bufshm->wr_pos] = *g;
-    sem_post(s_used);
-    bufshm->wr_pos++;
-    bufshm->wr_pos %= MAX_DATA;
-    sem_post(s_res);
+    return atomic_load_explicit(&bufshm->quit, memory_order_relaxed);
 }
 
-void read_buf(graph_t *graph)
+/**
+ * @brief spinning only pays off if the other side runs on another CPU
+ */
+static void init_spin(void)
 {
-    sem_wait(s_used);
-    struct bufshm *bufshm = get_buf();
-    graph = &bufshm->buf[bufshm->rd_pos];
-    sem_post(s_free);
-    bufshm->rd_pos++;
-    bufshm->rd_pos %= MAX_DATA;
+    spin_max = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SPIN_MAX : 0;
 }
 
 /**
- * @brief close shared memory and close and  unlink semaphores 
+ * @brief waits until word is not old anymore.
+ * Spins first, the number of rounds doubles when spinning was enough and halves
+ * when it was not, then sleeps on the futex.
+ *
+ * @param word futex word in the shared memory
+ * @param old value seen by the caller
+ * @param waiters count of sleepers on word
+ * @return int 0 once it changed, -1 if interrupted (by a signal) or the supervisor quit
  */
-static void close_shm_sem_unlink(void)
+static int wait_word(atomic_uint *word, unsigned int old, atomic_uint *waiters)
 {
-    close_shm_sem();
-    sem_unlink(SEM_FREE);
-    sem_unlink(SEM_RES);
-    sem_unlink(SEM_USED);
+    static _Thread_local unsigned int spins = SPIN_MIN;
+    unsigned int i;
+
+    if (spins > spin_max)
+        spins = spin_max;
+    for (i = 0; i < spins; i++)
+    {
+        if (atomic_load_explicit(word, memory_order_acquire) != old)
+        {
+            if (spins < spin_max)
+                spins *= 2;
+            return 0;
+        }
+        cpu_relax();
+    }
+    if (spins > SPIN_MIN)
+        spins /= 2;
+
+    for (;;)
+    {
+        long r = 0;
+
+        if (atomic_load(&bufshm->quit) && !created_buf)
+            return -1;
+        // the waker changes word before it reads waiters, so one of both sees the other
+        atomic_fetch_add(waiters, 1);
+        if (atomic_load(word) == old)
+            r = syscall(SYS_futex, word, FUTEX_WAIT, old, NULL, NULL, 0);
+        atomic_fetch_sub(waiters, 1);
+
+        if (r == -1 && errno == EINTR)
+            return -1;
+        if (atomic_load_explicit(word, memory_order_acquire) != old)
+            return 0;
+    }
 }
 
 /**
- * @brief close shared memory and semaphores
+ * @brief wakes up to n sleepers on word, no system call without sleepers
+ *
+ * @param word futex word in the shared memory
+ * @param waiters count of sleepers on word
+ * @param n sleepers to wake
  */
-static void close_shm_sem(void)
+static void wake_word(atomic_uint *word, atomic_uint *waiters, int n)
+{
+    if (atomic_load(waiters) != 0)
+        syscall(SYS_futex, word, FUTEX_WAKE, n, NULL, NULL, 0);
+}
+
+/**
+ * @brief tells the CPU that this is a spin loop
+ */
+static void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/**
+ * @brief close shared memory
+ */
+static void close_shm(void)
 {
     munmap(bufshm, sizeof(*bufshm));
     close(shmfd);
-    shm_unlink(SHM_NAME);
-    sem_close(SEM_FREE);
-    sem_close(SEM_USED);
-    sem_close(SEM_RES);
 }
 
-static struct bufshm *get_shm(void)
+/**
+ * @brief maps the shared memory
+ *
+ * @param create not 0 to create it (supervisor)
+ * @return struct bufshm* mapped buffer, NULL if it does not exist (yet)
+ */
+static struct bufshm *get_shm(int create)
 {
+    struct stat st;
+
     // create and/or open the shared memory object:
-    shmfd = shm_open(SHM_NAME, O_RDWR | O_CREAT, 0600);
+    shmfd = shm_open(SHM_NAME, create ? O_RDWR | O_CREAT : O_RDWR, 0600);
     if (shmfd == -1)
+    {
+        if (!create && errno == ENOENT)
+            return NULL;
         ERROR_MSG("shared memory opening failed", "");
+    }
 
     // set the size of the shared memory:
-    if (ftruncate(shmfd, sizeof(struct bufshm)) < 0)
+    if (create && ftruncate(shmfd, sizeof(struct bufshm)) < 0)
         ERROR_MSG("shared memory size failed", "");
+    if (!create && (fstat(shmfd, &st) == -1 || st.st_size < sizeof(struct bufshm)))
+    {
+        close(shmfd);
+        return NULL;
+    }
 
     // map shared memory object:
     struct bufshm *bufshm;
@@ -120,8 +314,5 @@ static struct bufshm *get_shm(void)
     if (bufshm == MAP_FAILED)
         ERROR_MSG("shared memory mapping failed", "");
 
-    // if (close(shmfd) == -1)
-    //     ERROR_MSG("shared memory closing failed", "");
-
     return bufshm;
 }
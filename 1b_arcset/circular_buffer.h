@@ -1,17 +1,50 @@
-#define MAX_DATA (50)
+#ifndef CIRCULAR_BUFFER_OS
+#define CIRCULAR_BUFFER_OS
 
-static struct bufshm
+#include <stdatomic.h>
+
+#define MAX_DATA (64) // power of two, positions wrap around at 2^32
+#define MAX_ARCS (8)  // larger arcsets are not published
+
+/**
+ * one arcset in the buffer, flat so it is valid in every process
+ */
+struct solution
+{
+    unsigned int n;             // edges
+    int edges[2 * MAX_ARCS];    // [from1, to1, from2, to2, ...]
+};
+
+/**
+ * slot of the ring. seq tells the state of the slot for position pos
+ * (pos % MAX_DATA == slot): pos -> free, pos + 1 -> written, readable.
+ * The reader frees it for the next round with pos + MAX_DATA.
+ */
+struct slot
+{
+    _Alignas(64) atomic_uint seq; // futex word of the reader
+    struct solution s;
+};
+
+/**
+ * multi producer, single consumer ring in shared memory
+ */
+struct bufshm
 {
-    unsigned int wr_pos;
-    unsigned int rd_pos;
-    graph_t buf[MAX_DATA];
+    _Alignas(64) atomic_uint wr_pos; // next position to claim (generators)
+    _Alignas(64) unsigned int rd_pos; // next position to read (supervisor only)
+    atomic_int quit;                 // set by the supervisor, generators stop
+    atomic_int ready;                // set by the supervisor once the slots are initialized
+    atomic_uint reader_waiting;      // reader sleeps on the seq of slot rd_pos
+    _Alignas(64) atomic_uint freed;  // futex word of the writers, counts freed slots
+    atomic_uint writers_waiting;     // writers sleeping on freed
+    struct slot buf[MAX_DATA];
 };
+#endif
 
 void init_buf(void);
 void get_buffer(void);
 void close_all(void);
-void write_buf(graph_t *g);
-void read_buf(graph_t *graph);
-static void close_shm_sem_unlink(void);
-static void close_shm_sem(void);
-static struct bufshm *get_shm(void);
+int write_buf(const int *edges, unsigned int n);
+int read_buf(struct solution *s);
+int buf_quit(void);
@@ -1,130 +1,461 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
 #include <unistd.h>
-#include <regex.h>
+#include <limits.h>
+#include <fcntl.h>
 #include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "error.h"
 #include "graph.h"
 #include "circular_buffer.h"
 
+#define MAX_THREADS (256)
+
 static char *prg_name;
 
-static void get_vertices_from_str(int *from, int *to, char *str);
-static int is_valid_argument(char *arg);
-static void argument_handler(int argc, char **argv, graph_t *g);
-static void gen_arcset(graph_t *input, graph_t *output);
+volatile sig_atomic_t quit = 0;
+
+/**
+ * growing array of parsed edges: [from1, to1, from2, to2, ...]
+ */
+struct edge_list
+{
+    int *edges;
+    unsigned int n; // edges
+    unsigned int cap;
+};
+
+/**
+ * generator thread: shares the read only graph, owns its ordering and solution buffer
+ */
+struct worker
+{
+    pthread_t thread;
+    const csr_t *csr;
+    unsigned int *pos;
+    int *solution;
+    rng_t rng; // own stream
+};
+
+static void argument_handler(int argc, char **argv, graph_t *g, unsigned int *threads, uint64_t *seed);
+static void read_text(const char *file_name, struct edge_list *list);
+static void load_binary(const char *file_name, graph_t *g);
+static void scan_edges(const char *p, const char *end, struct edge_list *list);
+static int scan_vertex(const char **p, const char *end);
+static void push_edge(struct edge_list *list, int from, int to);
+static void handle_signal(int signal);
+static void shuffle_positions(unsigned int *pos, unsigned int n, rng_t *rng);
+static unsigned int gen_arcset(const csr_t *csr, const unsigned int *pos, int *solution, unsigned int limit);
+static void *generate(void *arg);
 static void usage(void);
 
+/**
+ * Program entry point.
+ * @brief reads the graph and starts the generator threads (-t N, default 1).
+ * They share the graph and publish their arcsets to the circular buffer of the
+ * supervisor until it quits, or until SIGINT or SIGTERM.
+ * @param argc The argument counter.
+ * @param argv The argument vector.
+ * @return Returns EXIT_SUCCESS.
+ */
 int main(int argc, char **argv)
 {
-    srand(time(0));
-
     prg_name = argv[0];
-    graph_t graph = {0, 0, 0, 0, NULL, NULL};
-    graph_t arc_set = {0, 0, 0, 0, NULL, NULL};
-
-    argument_handler(argc, argv, &graph);
-    gen_arcset(&graph, &arc_set);
-    print_edges(&arc_set);
-    // write_buf(graph);
-    return 0;
+    graph_t graph = {0, 0, 0, 0, NULL, NULL, NULL, NULL, 0};
+    csr_t csr;
+    struct sigaction sa;
+    struct worker *workers;
+    unsigned int threads = 1, max_degree = 0, i, t;
+    struct timespec now;
+    uint64_t seed;
+    rng_t rng;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    // differs for generators started at the same time, unless -s SEED is given
+    clock_gettime(CLOCK_REALTIME, &now);
+    seed = ((uint64_t)now.tv_sec * 1000000000 + now.tv_nsec) ^ ((uint64_t)getpid() << 32);
+
+    argument_handler(argc, argv, &graph, &threads, &seed);
+    build_csr(&graph, &csr);
+    free_graph(&graph);
+    get_buffer();
+
+    // gen_arcset writes up to one vertex's out edges past the limit
+    for (i = 0; i < csr.n; i++)
+    {
+        if (csr.offsets[i + 1] - csr.offsets[i] > max_degree)
+            max_degree = csr.offsets[i + 1] - csr.offsets[i];
+    }
+
+    if ((workers = malloc(sizeof(struct worker) * threads)) == NULL)
+        ERROR_MSG("malloc error", prg_name);
+    rng_seed(&rng, seed);
+    for (t = 0; t < threads; t++)
+    {
+        workers[t].csr = &csr;
+        workers[t].rng = rng;
+        rng_jump(&rng);
+        workers[t].pos = malloc(sizeof(unsigned int) * csr.n);
+        workers[t].solution = malloc(sizeof(int) * 2 * (MAX_ARCS + 1 + (size_t)max_degree));
+        if (workers[t].pos == NULL || workers[t].solution == NULL)
+            ERROR_MSG("malloc error", prg_name);
+        for (i = 0; i < csr.n; i++)
+            workers[t].pos[i] = i;
+        if (pthread_create(&workers[t].thread, NULL, generate, &workers[t]) != 0)
+            ERROR_MSG("pthread_create failed", prg_name);
+    }
+
+    for (t = 0; t < threads; t++)
+    {
+        pthread_join(workers[t].thread, NULL);
+        free(workers[t].pos);
+        free(workers[t].solution);
+    }
+
+    free(workers);
+    free_csr(&csr);
+    close_all();
+    return EXIT_SUCCESS;
 }
 
 /**
- * @brief checks if all input arguments are valid and puts them into data structure
+ * @brief reads the edges of the graph and puts them into data structure.
+ * Edges come from the arguments, from a text file (-f FILE, "-" for stdin) or
+ * from a binary file (-b FILE), without any of these from stdin.
  * 
  * @param argc argument counter
  * @param argv argument vector
+ * @param g graph
+ * @param threads receives the number of generator threads (-t N)
+ * @param seed receives the seed (-s SEED), the same seed replays the same orderings
  */
-static void argument_handler(int argc, char **argv, graph_t *g)
+static void argument_handler(int argc, char **argv, graph_t *g, unsigned int *threads, uint64_t *seed)
 {
-    if (argc - optind < 1)
+    struct edge_list list = {NULL, 0, 0};
+    const char *text = NULL, *binary = NULL;
+    char *end;
+    long n;
+    int c, i;
+
+    while ((c = getopt(argc, argv, "f:b:t:s:")) != -1)
+    {
+        switch (c)
+        {
+        case ('s'):
+            // strtoull() takes a sign and leading spaces, "-1" would be 2^64 - 1
+            if (*optarg < '0' || *optarg > '9')
+                usage();
+            errno = 0;
+            *seed = strtoull(optarg, &end, 10);
+            if (*end != '\0' || errno == ERANGE)
+                usage();
+            break;
+        case ('t'):
+            n = strtol(optarg, &end, 10);
+            if (*end != '\0' || n < 1 || n > MAX_THREADS)
+                usage();
+            *threads = n;
+            break;
+        case ('f'):
+            text = optarg;
+            break;
+        case ('b'):
+            binary = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if ((text != NULL || binary != NULL) && argc - optind > 0)
         usage();
 
-    int i;
+    if (binary != NULL)
+        load_binary(binary, g);
+    if (text != NULL || (binary == NULL && argc - optind == 0))
+        read_text(text == NULL ? "-" : text, &list);
     for (i = optind; i < argc; i++)
-    {
-        int from, to;
-        get_vertices_from_str(&from, &to, argv[i]);
+        scan_edges(argv[i], argv[i] + strlen(argv[i]), &list);
 
-        insert_vertex(g, from);
-        insert_vertex(g, to);
-        insert_edge(g, from, to);
+    load_edges(g, list.edges, list.n);
+    free(list.edges);
+    if (g->v_top == 0)
+        usage();
+}
+
+/**
+ * @brief signal handler, ends the generator loop
+ * 
+ * @param signal received signal
+ */
+static void handle_signal(int signal)
+{
+    quit = 1;
+}
+
+/**
+ * @brief random vertex ordering: Fisher-Yates shuffle of the position array
+ * (pos[i]: position of the vertex with dense index i)
+ * 
+ * @param pos position array, a permutation of 0 .. n - 1
+ * @param n vertices
+ * @param rng random number generator of the thread
+ */
+static void shuffle_positions(unsigned int *pos, unsigned int n, rng_t *rng)
+{
+    unsigned int i, r, tmp;
+
+    for (i = n; i-- > 1;)
+    {
+        r = rng_bounded(rng, i + 1);
+        tmp = pos[i];
+        pos[i] = pos[r];
+        pos[r] = tmp;
     }
 }
 
 /**
- * @brief generates a heuristic arcset from input and saves it into output
+ * @brief generates a heuristic arcset for the vertex ordering pos: all edges
+ * going backwards. The edges are walked in the csr form, so one ordering costs
+ * a single O(E) pass. Stops early once the arcset reaches limit edges,
+ * it can't be better than a known one then (checked once per vertex).
  * 
- * @param input input graph
- * @param output output graph (heuristic arcset)
+ * @param csr input graph
+ * @param pos position of every vertex (by dense index)
+ * @param solution receives the arcset [from1, to1, ...], room for limit + max out degree edges
+ * @param limit size of the best known arcset
+ * @return unsigned int edges in the arcset (limit if it got cut off)
  */
-static void gen_arcset(graph_t *input, graph_t *output)
+static unsigned int gen_arcset(const csr_t *csr, const unsigned int *pos, int *solution, unsigned int limit)
 {
-    int i, from, to;
-    shuffle_vertices(input);
-    for (i = 0; i < input->e_top; i++)
+    unsigned int u, e, n = 0;
+
+    for (u = 0; u < csr->n; u++)
     {
-        from = input->edges[i];
-        to = input->edges[++i];
+        unsigned int from = pos[u], end = csr->offsets[u + 1];
+        int id = csr->ids[u];
 
-        if (index_of_vertex(input, from) > index_of_vertex(input, to))
+        // branch free: every edge is written, n only moves on for backward ones
+        for (e = csr->offsets[u]; e < end; e++)
         {
-            insert_vertex(output, from);
-            insert_vertex(output, to);
-            insert_edge(output, from, to);
+            unsigned int to = csr->targets[e];
+            solution[2 * n] = id;
+            solution[2 * n + 1] = csr->ids[to];
+            n += from > pos[to];
         }
+        if (n >= limit)
+            return limit;
     }
+    return n;
 }
 
 /**
- * @brief Takes an argument string (eg. "1-3") and extracts the vertecies. 
- * This functions throws an error if the sting is an illigal argument.
- * Saves the result in from and to (eg. from = 1, to = 3)
+ * @brief generator thread: generates arcsets of random orderings and publishes
+ * every one that is smaller than its ones before and has at most MAX_ARCS edges
  * 
- * @param from vertex from
- * @param to vertex to
- * @param str input argument [0..n]-[0..m] n,m are natural numbers
+ * @param arg struct worker
+ * @return void* NULL
  */
-static void get_vertices_from_str(int *from, int *to, char *str)
+static void *generate(void *arg)
 {
-    if (!is_valid_argument(str))
-        ERROR_MSG("illigal argument format", prg_name);
+    struct worker *w = arg;
+    unsigned int best = MAX_ARCS + 1, n;
+
+    while (!quit && !buf_quit() && best > 0)
+    {
+        shuffle_positions(w->pos, w->csr->n, &w->rng);
+        n = gen_arcset(w->csr, w->pos, w->solution, best);
+        if (n < best)
+        {
+            best = n;
+            if (write_buf(w->solution, n) == -1)
+                break;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief reads a text edge list ("1-2 3-4 ...", separated by any white space).
+ * Regular files are memory mapped, anything else (stdin) is read into a buffer.
+ * 
+ * @param file_name file to read, "-" for stdin
+ * @param list receives the edges
+ */
+static void read_text(const char *file_name, struct edge_list *list)
+{
+    int fd = strcmp(file_name, "-") == 0 ? STDIN_FILENO : open(file_name, O_RDONLY);
+    struct stat st;
+    char *data;
+    size_t len = 0, cap = 1 << 16;
+
+    if (fd == -1 || fstat(fd, &st) == -1)
+        ERROR_MSG("open edge list failed", prg_name);
 
-    int index = 0;
-    for (; *(str + index) != '\0'; index++)
+    if (S_ISREG(st.st_mode) && st.st_size > 0)
     {
-        if (*(str + index) == '-')
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+            ERROR_MSG("mmap failed", prg_name);
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+        scan_edges(data, data + st.st_size, list);
+        munmap(data, st.st_size);
+    }
+    else
+    {
+        if ((data = malloc(cap)) == NULL)
+            ERROR_MSG("malloc error", prg_name);
+        for (;;)
         {
-            *(str + index) = '\0';
-            *from = atoi(str);
-            *to = atoi((str + index) + 1);
+            ssize_t n;
+            if (len == cap)
+            {
+                char *newptr = realloc(data, cap *= 2);
+                if (newptr == NULL)
+                    ERROR_MSG("realloc error", prg_name);
+                data = newptr;
+            }
+            if ((n = read(fd, data + len, cap - len)) == 0)
+                break;
+            if (n == -1)
+                ERROR_MSG("read failed", prg_name);
+            len += n;
         }
+        scan_edges(data, data + len, list);
+        free(data);
     }
+
+    if (fd != STDIN_FILENO)
+        close(fd);
 }
 
 /**
- * @brief checks if string matches [0..n]-[0..m]
- *  examples: 1-2 3-4
+ * @brief loads a binary edge list: native uint32 pairs (from, to), memory mapped
+ * and passed to the graph without copying
  * 
- * @param arg 
- * @return int returns 1 for match and 0 for no match
+ * @param file_name file to read
+ * @param g graph
  */
-static int is_valid_argument(char *arg)
+static void load_binary(const char *file_name, graph_t *g)
 {
-    regex_t regex;
-    int reti;
+    int fd = open(file_name, O_RDONLY);
+    struct stat st;
+    const uint32_t *data;
+    size_t i, n;
 
-    /* Compile regular expression */
-    reti = regcomp(&regex, "^[0-9][0-9]*-[0-9][0-9]*$", 0);
-    if (reti)
+    if (fd == -1 || fstat(fd, &st) == -1)
+        ERROR_MSG("open edge list failed", prg_name);
+    if (st.st_size % (2 * sizeof(uint32_t)) != 0)
+        ERROR_MSG("binary edge list size is not a multiple of 8", prg_name);
+    if ((n = st.st_size / (2 * sizeof(uint32_t))) == 0)
     {
-        ERROR_MSG("Regex compile error", prg_name);
-        exit(EXIT_FAILURE);
+        close(fd);
+        return;
     }
+    if (n > UINT_MAX / 2)
+        ERROR_MSG("binary edge list has too many edges", prg_name);
+
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+        ERROR_MSG("mmap failed", prg_name);
+    close(fd);
+    madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
 
-    reti = regexec(&regex, arg, 0, NULL, 0);
-    return !reti;
+    // vertices are ints
+    for (i = 0; i < 2 * n; i++)
+    {
+        if (data[i] > INT_MAX)
+            ERROR_MSG("vertex out of range", prg_name);
+    }
+    load_edges(g, (const int *)data, n);
+    munmap((void *)data, st.st_size);
+}
+
+/**
+ * @brief hand written scanner for edges "FROM-TO" separated by white space
+ * (a single argument, or a whole text file). Throws an error for anything else.
+ * 
+ * @param p start of the text
+ * @param end end of the text
+ * @param list receives the edges
+ */
+static void scan_edges(const char *p, const char *end, struct edge_list *list)
+{
+    for (;;)
+    {
+        int from, to;
+
+        while (p < end && (*p == ' ' || *p == '\n' || *p == '\t' || *p == '\r'))
+            p++;
+        if (p == end)
+            return;
+
+        from = scan_vertex(&p, end);
+        if (p == end || *p != '-')
+            ERROR_MSG("illigal argument format", prg_name);
+        p++;
+        to = scan_vertex(&p, end);
+        if (p < end && *p != ' ' && *p != '\n' && *p != '\t' && *p != '\r')
+            ERROR_MSG("illigal argument format", prg_name);
+
+        push_edge(list, from, to);
+    }
+}
+
+/**
+ * @brief scans a vertex [0..n] and moves p behind it
+ * 
+ * @param p current position, moved behind the digits
+ * @param end end of the text
+ * @return int the vertex
+ */
+static int scan_vertex(const char **p, const char *end)
+{
+    const char *s = *p;
+    long v = 0;
+
+    if (s == end || *s < '0' || *s > '9')
+        ERROR_MSG("illigal argument format", prg_name);
+    for (; s < end && *s >= '0' && *s <= '9'; s++)
+    {
+        v = v * 10 + (*s - '0');
+        if (v > INT_MAX)
+            ERROR_MSG("vertex out of range", prg_name);
+    }
+    *p = s;
+    return (int)v;
+}
+
+/**
+ * @brief appends an edge to the list, the list grows geometrically
+ * 
+ * @param list edge list
+ * @param from vertex from
+ * @param to vertex to
+ */
+static void push_edge(struct edge_list *list, int from, int to)
+{
+    if (list->n == list->cap)
+    {
+        unsigned int newcap = list->cap == 0 ? 1024 : 2 * list->cap;
+        int *newptr = realloc(list->edges, sizeof(int) * 2 * (size_t)newcap);
+        if (newptr == NULL)
+            ERROR_MSG("realloc error", prg_name);
+        list->edges = newptr;
+        list->cap = newcap;
+    }
+    list->edges[2 * list->n] = from;
+    list->edges[2 * list->n + 1] = to;
+    list->n++;
 }
 
 /**
@@ -133,7 +464,7 @@ static int is_valid_argument(char *arg)
  */
 static void usage(void)
 {
-    (void)fprintf(stderr, "USAGE: %s EDGE1...\n", prg_name);
+    (void)fprintf(stderr, "USAGE: %s [-t N] [-s SEED] [-f FILE | -b FILE | EDGE1...]\n", prg_name);
 
     exit(EXIT_FAILURE);
 }
@@ -3,6 +3,13 @@
 #include "graph.h"
 #include "error.h"
 
+static unsigned int hash_vertex(int vertex);
+static struct vertex_slot *find_slot(graph_t *g, int vertex);
+static void grow_slots(graph_t *g);
+static void reserve_vertices(graph_t *g, unsigned int n);
+static void reserve_edges(graph_t *g, unsigned int n);
+static uint64_t rotl(uint64_t x, int k);
+
 /**
  * @brief gets index of vertex in graph -> vertices
  * 
@@ -12,33 +19,96 @@
  */
 int index_of_vertex(graph_t *g, int vertex)
 {
-    int i;
-    for (i = 0; i < g->v_top; i++)
+    int i = dense_index(g, vertex);
+    return i == -1 ? -1 : (int)g->pos[i];
+}
+
+/**
+ * @brief gets the dense index of a vertex: vertices are numbered 0..v_top - 1 in insertion order,
+ * the number does not change when the vertices are shuffled
+ * 
+ * @param g graph
+ * @param vertex vertex
+ * @return int returns the dense index of vertex, -1 if vertex does not exist in vertices set
+ */
+int dense_index(graph_t *g, int vertex)
+{
+    if (g->slots == NULL)
+        return -1;
+    return (int)find_slot(g, vertex)->index - 1;
+}
+
+/**
+ * @brief mixes the bits of a vertex id for the hash map
+ * 
+ * @param vertex vertex
+ * @return unsigned int hash value
+ */
+static unsigned int hash_vertex(int vertex)
+{
+    unsigned int h = (unsigned int)vertex * 0x9E3779B1u;
+    return h ^ (h >> 16);
+}
+
+/**
+ * @brief finds the slot of a vertex in the hash map (linear probing)
+ * 
+ * @param g graph with slots
+ * @param vertex vertex
+ * @return struct vertex_slot* the slot of vertex, or the empty slot where it belongs
+ */
+static struct vertex_slot *find_slot(graph_t *g, int vertex)
+{
+    unsigned int i = hash_vertex(vertex) & g->s_mask;
+
+    while (g->slots[i].index != 0 && g->slots[i].vertex != vertex)
+        i = (i + 1) & g->s_mask;
+    return &g->slots[i];
+}
+
+/**
+ * @brief doubles the hash map and inserts all vertices again
+ * 
+ * @param g graph
+ */
+static void grow_slots(graph_t *g)
+{
+    struct vertex_slot *old = g->slots;
+    unsigned int i, n = old == NULL ? 0 : g->s_mask + 1;
+    unsigned int newsize = n == 0 ? 64 : 2 * n;
+
+    g->slots = calloc(newsize, sizeof(*g->slots));
+    if (g->slots == NULL)
+        ERROR_MSG("calloc error", "");
+    g->s_mask = newsize - 1;
+
+    for (i = 0; i < n; i++)
     {
-        if (g->vertices[i] == vertex)
-            return i;
+        if (old[i].index != 0)
+            *find_slot(g, old[i].vertex) = old[i];
     }
-    return -1;
+    free(old);
 }
 
 /**
  * @brief shuffles all vertices in graph randomly
  * 
  * @param g graph
+ * @param rng random number generator
  */
-void shuffle_vertices(graph_t *g)
+void shuffle_vertices(graph_t *g, rng_t *rng)
 {
     int i, r;
 
     for (i = g->v_top - 1; i >= 1; i--)
     {
-        r = random_int(0, i);
+        r = random_int(rng, 0, i);
         swap_vertices(g, i, r);
     }
 }
 
 /**
- * @brief swaps position of two vertices in graph
+ * @brief swaps position of two vertices in graph (and their entries in pos)
  * 
  * @param g graph
  * @param i vertex1 index
@@ -52,6 +122,9 @@ void swap_vertices(graph_t *g, int i, int j)
     int tmp = g->vertices[i];
     g->vertices[i] = g->vertices[j];
     g->vertices[j] = tmp;
+
+    g->pos[dense_index(g, g->vertices[i])] = i;
+    g->pos[dense_index(g, g->vertices[j])] = j;
 }
 
 /**
@@ -96,17 +169,19 @@ void print_edges(graph_t *g)
  */
 void insert_vertex(graph_t *g, int vertex)
 {
-    if (!graph_contains_vertex(g, vertex))
+    struct vertex_slot *slot;
+
+    // keep the hash map at most half full
+    if (g->slots == NULL || 2 * (g->v_top + 1) > g->s_mask + 1)
+        grow_slots(g);
+    slot = find_slot(g, vertex);
+    if (slot->index == 0)
     {
         if (g->v_top == g->v_cap)
-        {
-            int newcap = g->v_cap + 10;
-            int *newptr = realloc(g->vertices, sizeof(int) * newcap);
-            if (newptr == NULL)
-                ERROR_MSG("realloc error", "");
-            g->vertices = newptr;
-            g->v_cap = newcap;
-        }
+            reserve_vertices(g, g->v_cap == 0 ? 16 : 2 * g->v_cap);
+        slot->vertex = vertex;
+        slot->index = g->v_top + 1;
+        g->pos[g->v_top] = g->v_top;
         g->vertices[g->v_top++] = vertex;
     }
 }
@@ -121,18 +196,143 @@ void insert_vertex(graph_t *g, int vertex)
 void insert_edge(graph_t *g, int from, int to)
 {
     if (g->e_top == g->e_cap)
-    {
-        int newcap = g->e_cap + 10;
-        int *newptr = realloc(g->edges, sizeof(int) * newcap);
-        if (newptr == NULL)
-            ERROR_MSG("realloc error", "");
-        g->edges = newptr;
-        g->e_cap = newcap;
-    }
+        reserve_edges(g, g->e_cap == 0 ? 32 : 2 * g->e_cap);
     g->edges[g->e_top++] = from;
     g->edges[g->e_top++] = to;
 }
 
+/**
+ * @brief grows the vertex arrays (vertices, pos) to room for n vertices
+ * 
+ * @param g graph
+ * @param n new capacity, not below v_cap
+ */
+static void reserve_vertices(graph_t *g, unsigned int n)
+{
+    if (n <= g->v_cap)
+        return;
+
+    int *newptr = realloc(g->vertices, sizeof(int) * n);
+    if (newptr == NULL)
+        ERROR_MSG("realloc error", "");
+    g->vertices = newptr;
+    unsigned int *newpos = realloc(g->pos, sizeof(unsigned int) * n);
+    if (newpos == NULL)
+        ERROR_MSG("realloc error", "");
+    g->pos = newpos;
+    g->v_cap = n;
+}
+
+/**
+ * @brief grows the edge array to room for n ints (n / 2 edges)
+ * 
+ * @param g graph
+ * @param n new capacity in ints, not below e_cap
+ */
+static void reserve_edges(graph_t *g, unsigned int n)
+{
+    if (n <= g->e_cap)
+        return;
+
+    int *newptr = realloc(g->edges, sizeof(int) * n);
+    if (newptr == NULL)
+        ERROR_MSG("realloc error", "");
+    g->edges = newptr;
+    g->e_cap = n;
+}
+
+/**
+ * @brief inserts many edges and their vertices at once, the arrays are grown only once
+ * 
+ * @param g graph
+ * @param edges n edges: [from1, to1, from2, to2, ...]
+ * @param n number of edges
+ */
+void load_edges(graph_t *g, const int *edges, unsigned int n)
+{
+    unsigned int i;
+
+    reserve_edges(g, g->e_top + 2 * n);
+    for (i = 0; i < 2 * n; i += 2)
+    {
+        insert_vertex(g, edges[i]);
+        insert_vertex(g, edges[i + 1]);
+        insert_edge(g, edges[i], edges[i + 1]);
+    }
+}
+
+/**
+ * @brief builds the compressed sparse row form of a graph (counting sort of the edges by source).
+ * The edge list of the graph stays as it is.
+ * 
+ * @param g graph
+ * @param csr receives the csr graph, release with free_csr()
+ */
+void build_csr(graph_t *g, csr_t *csr)
+{
+    unsigned int i, n = g->v_top, m = g->e_top / 2;
+    char *block = malloc(sizeof(int) * n + sizeof(unsigned int) * (n + 1) + sizeof(unsigned int) * m);
+
+    if (block == NULL)
+        ERROR_MSG("malloc error", "");
+    csr->n = n;
+    csr->m = m;
+    csr->ids = (int *)block;
+    csr->offsets = (unsigned int *)(block + sizeof(int) * n);
+    csr->targets = csr->offsets + n + 1;
+
+    for (i = 0; i < n; i++)
+        csr->ids[dense_index(g, g->vertices[i])] = g->vertices[i];
+
+    // count the out edges, offsets[i + 1] ends up as the start of vertex i + 1
+    for (i = 0; i <= n; i++)
+        csr->offsets[i] = 0;
+    for (i = 0; i < m; i++)
+        csr->offsets[dense_index(g, g->edges[2 * i]) + 1]++;
+    for (i = 0; i < n; i++)
+        csr->offsets[i + 1] += csr->offsets[i];
+
+    // fill, offsets[i] is used as the write position of vertex i and moved back afterwards
+    for (i = 0; i < m; i++)
+        csr->targets[csr->offsets[dense_index(g, g->edges[2 * i])]++] = dense_index(g, g->edges[2 * i + 1]);
+    for (i = n; i > 0; i--)
+        csr->offsets[i] = csr->offsets[i - 1];
+    csr->offsets[0] = 0;
+}
+
+/**
+ * @brief frees a csr graph
+ * 
+ * @param csr csr graph
+ */
+void free_csr(csr_t *csr)
+{
+    free(csr->ids);
+    csr->ids = NULL;
+    csr->offsets = NULL;
+    csr->targets = NULL;
+    csr->n = 0;
+    csr->m = 0;
+}
+
+/**
+ * @brief frees all arrays of a graph and leaves it empty
+ * 
+ * @param g graph
+ */
+void free_graph(graph_t *g)
+{
+    free(g->vertices);
+    free(g->edges);
+    free(g->pos);
+    free(g->slots);
+    g->vertices = NULL;
+    g->edges = NULL;
+    g->pos = NULL;
+    g->slots = NULL;
+    g->v_top = g->v_cap = g->e_top = g->e_cap = g->s_mask = 0;
+}
+
 /**
  * @brief checks if a graph already contains the vertex
  * 
@@ -142,23 +342,124 @@ void insert_edge(graph_t *g, int from, int to)
  */
 int graph_contains_vertex(graph_t *g, int vertex)
 {
-    int i;
-    for (i = 0; i < g->v_top; i++)
-    {
-        if (g->vertices[i] == vertex)
-            return 1;
-    }
-    return 0;
+    return dense_index(g, vertex) != -1;
 }
 
 /**
  * @brief Generates a random int i: min <= i <= max
  * 
+ * @param r random number generator
  * @param min 
  * @param max 
  * @return int 
  */
-int random_int(int min, int max)
+int random_int(rng_t *r, int min, int max)
 {
-    return (rand() % (max - min + 1)) + min;
+    return (int)rng_bounded(r, (uint32_t)(max - min) + 1) + min;
+}
+
+/**
+ * @brief seeds the generator, the state is filled by splitmix64
+ * 
+ * @param r random number generator
+ * @param seed seed
+ */
+void rng_seed(rng_t *r, uint64_t seed)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+    {
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        r->s[i] = z ^ (z >> 31);
+    }
+}
+
+/**
+ * @brief rotates x left by k bits
+ * 
+ * @param x value
+ * @param k bits, 0 < k < 64
+ * @return uint64_t rotated value
+ */
+static uint64_t rotl(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * @brief next random number (xoshiro256**)
+ * 
+ * @param r random number generator
+ * @return uint64_t random number
+ */
+uint64_t rng_next(rng_t *r)
+{
+    uint64_t *s = r->s;
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+/**
+ * @brief moves the generator 2^128 numbers ahead, gives 2^128 non overlapping streams
+ * 
+ * @param r random number generator
+ */
+void rng_jump(rng_t *r)
+{
+    static const uint64_t jump[] = {0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL, 0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL};
+    uint64_t s[4] = {0, 0, 0, 0};
+    int i, b;
+
+    for (i = 0; i < 4; i++)
+    {
+        for (b = 0; b < 64; b++)
+        {
+            if (jump[i] & (1ULL << b))
+            {
+                s[0] ^= r->s[0];
+                s[1] ^= r->s[1];
+                s[2] ^= r->s[2];
+                s[3] ^= r->s[3];
+            }
+            rng_next(r);
+        }
+    }
+    for (i = 0; i < 4; i++)
+        r->s[i] = s[i];
+}
+
+/**
+ * @brief unbiased random number in [0, range) by Lemire's multiply and reject method:
+ * no division unless the first draw falls into the small biased part
+ * 
+ * @param r random number generator
+ * @param range number of values, at least 1
+ * @return uint32_t random number
+ */
+uint32_t rng_bounded(rng_t *r, uint32_t range)
+{
+    uint64_t m = (rng_next(r) >> 32) * range;
+    uint32_t low = (uint32_t)m;
+
+    if (low < range)
+    {
+        uint32_t threshold = -range % range;
+        while (low < threshold)
+        {
+            m = (rng_next(r) >> 32) * range;
+            low = (uint32_t)m;
+        }
+    }
+    return m >> 32;
 }
@@ -1,6 +1,17 @@
 #ifndef GRAPH_OS
 #define GRAPH_OS
 
+#include <stdint.h>
+
+/**
+ * slot of the vertex hash map: vertex id -> dense index (insertion order)
+ */
+struct vertex_slot
+{
+    int vertex;
+    unsigned int index; // dense index + 1, 0 for an empty slot
+};
+
 typedef struct graph
 {
     unsigned int v_top;
@@ -8,16 +19,52 @@ typedef struct graph
     unsigned int e_top;
     unsigned int e_cap;
     int *vertices;
-    int *edges; // saves one edge: [from1, to1, from2, to2, ...]
+    int *edges;                // saves one edge: [from1, to1, from2, to2, ...]
+    unsigned int *pos;         // pos[i]: index in vertices of the vertex with dense index i
+    struct vertex_slot *slots; // open addressing hash map, twice as many slots as vertices at least
+    unsigned int s_mask;       // number of slots - 1
 } graph_t;
+
+/**
+ * compressed sparse row form of a graph, built by build_csr().
+ * Vertices are numbered by their dense index, the out edges of vertex i
+ * go to targets[offsets[i]] .. targets[offsets[i + 1] - 1].
+ * ids, offsets and targets share one allocation.
+ */
+typedef struct csr
+{
+    unsigned int n; // vertices
+    unsigned int m; // edges
+    int *ids;       // ids[i]: vertex id of dense index i
+    unsigned int *offsets;
+    unsigned int *targets;
+} csr_t;
+
+/**
+ * xoshiro256** random number generator, one per thread.
+ * rng_jump() moves it 2^128 numbers ahead: a new stream that never overlaps.
+ */
+typedef struct rng
+{
+    uint64_t s[4];
+} rng_t;
 #endif
 
 int graph_contains_vertex(graph_t *g, int vertex);
 void insert_vertex(graph_t *g, int vertex);
 void insert_edge(graph_t *g, int from, int to);
-void shuffle_vertices(graph_t *g);
-int random_int(int min, int max);
+void shuffle_vertices(graph_t *g, rng_t *r);
+int random_int(rng_t *r, int min, int max);
+void rng_seed(rng_t *r, uint64_t seed);
+void rng_jump(rng_t *r);
+uint64_t rng_next(rng_t *r);
+uint32_t rng_bounded(rng_t *r, uint32_t range);
 void print_vertecies(graph_t *g);
 void print_edges(graph_t *g);
 int index_of_vertex(graph_t *g, int vertex);
+int dense_index(graph_t *g, int vertex);
 void swap_vertices(graph_t *g, int i, int j);
+void load_edges(graph_t *g, const int *edges, unsigned int n);
+void build_csr(graph_t *g, csr_t *csr);
+void free_csr(csr_t *csr);
+void free_graph(graph_t *g);
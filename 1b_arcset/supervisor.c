@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <signal.h>
 #include "error.h"
 #include "graph.h"
@@ -9,15 +10,64 @@ volatile sig_atomic_t quit = 0;
 
 void handle_signal(int signal) { quit = 1; }
 
+static void print_solution(const char *prg_name, const struct solution *s);
+
+/**
+ * Program entry point.
+ * @brief creates the circular buffer and reads the arcsets of the generators
+ * until SIGINT or SIGTERM, or until the graph turns out to be acyclic.
+ * Every arcset smaller than all before is printed.
+ * @param argc The argument counter.
+ * @param argv The argument vector.
+ * @return Returns EXIT_SUCCESS.
+ */
 int main(int argc, char **argv)
 {
     struct sigaction sa;
+    struct solution s;
+    unsigned int best = MAX_ARCS + 1;
+
+    memset(&sa, 0, sizeof(sa));
     sa.sa_handler = handle_signal;
     sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
 
+    init_buf();
     while (!quit)
     {
+        if (read_buf(&s) == -1)
+            continue;
+        if (s.n < best)
+        {
+            best = s.n;
+            print_solution(argv[0], &s);
+            if (best == 0)
+                break;
+        }
     }
 
-    return 0;
-}
\ No newline at end of file
+    close_all();
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief prints an arcset, or that the graph is acyclic
+ * 
+ * @param prg_name program name
+ * @param s arcset
+ */
+static void print_solution(const char *prg_name, const struct solution *s)
+{
+    unsigned int i;
+
+    if (s->n == 0)
+    {
+        printf("[%s] The graph is acyclic!\n", prg_name);
+        return;
+    }
+    printf("[%s] Solution with %u edges:", prg_name, s->n);
+    for (i = 0; i < s->n; i++)
+        printf(" %d-%d", s->edges[2 * i], s->edges[2 * i + 1]);
+    printf("\n");
+    fflush(stdout);
+}